@@ -0,0 +1,51 @@
+# PlatformIO extra script: generates asm_offsets.h with the struct sizes and member offsets
+# used by the assembly code (see src/asm_offsets.cpp) before every build. The build fails
+# if the header can't be generated.
+
+Import("env", "projenv")
+
+import os
+import re
+import subprocess
+import sys
+
+
+def generate_asm_offsets():
+    source = os.path.join(projenv.subst("$PROJECT_SRC_DIR"), "asm_offsets.cpp")
+    out_dir = os.path.join(projenv.subst("$BUILD_DIR"), "generated")
+    out_file = os.path.join(out_dir, "asm_offsets.h")
+
+    # Same compiler and flags as the project sources, but compile to assembly only
+    command = projenv.subst("$CXX -S -o - $CXXFLAGS $CCFLAGS $_CCCOMCOM -DGENERATE_ASM_OFFSETS") + \
+        ' "%s"' % source
+    result = subprocess.run(command, shell=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+        universal_newlines=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stderr)
+        sys.stderr.write("Error: cannot compile %s\n" % source)
+        env.Exit(1)
+
+    # The operand may have an immediate value prefix on some targets
+    values = re.findall(r"^\s*->(\w+)\s+[$#]?(-?\d+)", result.stdout, re.MULTILINE)
+    if not values:
+        sys.stderr.write("Error: no offsets found in %s\n" % source)
+        env.Exit(1)
+
+    lines = ["// Generated by gen_asm_offsets.py from asm_offsets.cpp, don't edit", "", "#pragma once", ""]
+    lines += ["#define %s %s" % value for value in values]
+    text = "\n".join(lines) + "\n"
+
+    # Don't touch an unchanged header, so the assembly files aren't rebuilt every time
+    if os.path.isfile(out_file):
+        with open(out_file) as f:
+            if f.read() == text:
+                return
+
+    if not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+    with open(out_file, "w") as f:
+        f.write(text)
+
+
+generate_asm_offsets()
+projenv.Append(CPPPATH=[os.path.join(projenv.subst("$BUILD_DIR"), "generated")])
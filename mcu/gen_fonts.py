@@ -0,0 +1,116 @@
+# PlatformIO extra script: run-length encodes the font bitmaps (see src/display/fonts) for
+# PrintGlyph before every build. The fonts stay in the Adafruit GFX format produced by
+# fontconvert, the encoded copies go to the generated headers with the "_rle" suffix.
+# The build fails if a font can't be parsed.
+#
+# The glyph bitmap is a sequence of 4-bit codes, high nibble first, which describe the pixel
+# runs of the glyph box in the left-right-up-down order. The runs alternate, starting with
+# the background color:
+# 1..15 - the next run of this length
+# 0     - adds 15 pixels to the current run, or means an empty first run (the glyph starts
+#         with the foreground color) if it is the first code of the glyph
+# Each glyph starts from the high nibble of its own byte.
+
+Import("env", "projenv")
+
+import os
+import re
+import sys
+
+FONTS = ["FreeSans12", "FreeSans18", "FreeSans24"]
+
+
+def parse_font(text):
+    name = re.search(r"namespace\s+display::(\w+)", text).group(1)
+    glyphs = re.findall(r"^\s*\{(\d+),\s*(\d+),\s*(\d+),\s*(\d+),\s*(-?\d+),\s*(-?\d+)\},?\s*(//.*)?$",
+        text, re.MULTILINE)
+    header = re.search(r"g_font\s+PROGMEM\s*=\s*\{\s*g_glyphs,\s*(\w+),\s*(\w+),\s*(-?\d+),\s*(\d+),\s*\{([^}]*)\}",
+        text)
+    if not glyphs or not header:
+        return None
+
+    glyphs = [[int(v) for v in glyph[:6]] + [glyph[6] or ""] for glyph in glyphs]
+    bitmaps = [int(v, 16) for v in re.findall(r"0x[0-9A-Fa-f]+", header.group(5))]
+    return name, glyphs, header.groups()[:4], bitmaps
+
+
+def encode_glyph(bitmaps, offset, width, height):
+    # Only the first run can be empty
+    runs = [0]
+    color = 0
+    for i in range(width*height):
+        bit = (bitmaps[offset + i//8] >> (7 - i%8)) & 1
+        if bit != color:
+            runs.append(0)
+            color = bit
+        runs[-1] += 1
+
+    codes = []
+    for run in runs:
+        if not run:
+            codes.append(0)
+            continue
+        extra = (run - 1)//15
+        codes.append(run - extra*15)
+        codes += [0]*extra
+
+    if len(codes) % 2:
+        codes.append(0)
+    return [codes[i]*16 + codes[i + 1] for i in range(0, len(codes), 2)]
+
+
+def encode_font(text):
+    font = parse_font(text)
+    if not font:
+        return None
+
+    name, glyphs, header, bitmaps = font
+    lines = ["// Generated by gen_fonts.py from fonts/%s.h, don't edit" % name, "", "#pragma once", "",
+        '#include "display/display.h"', "", "namespace display::%s {" % name, "",
+        "const Glyph g_glyphs[] PROGMEM =", "{"]
+
+    encoded = []
+    for offset, width, height, x_advance, x_offset, y_offset, comment in glyphs:
+        entry = "{%d, %d, %d, %d, %d, %d}," % (len(encoded), width, height, x_advance, x_offset, y_offset)
+        lines.append(("    %-27s %s" % (entry, comment)).rstrip())
+        if width and height:
+            encoded += encode_glyph(bitmaps, offset, width, height)
+
+    lines += ["};", "", "// Approximately %d bytes (%d before encoding)" %
+        (len(glyphs)*7 + 6 + len(encoded), len(glyphs)*7 + 6 + len(bitmaps)),
+        "const Font g_font PROGMEM =", "{", "    g_glyphs, %s, %s, %s, %s," % header, "    {"]
+    for i in range(0, len(encoded), 12):
+        lines.append("        " + ", ".join("0x%02X" % v for v in encoded[i:i + 12]) + ",")
+    lines[-1] = lines[-1][:-1]
+    lines += ["    }", "};", "", "} // namespace display::%s" % name]
+    return "\n".join(lines) + "\n"
+
+
+def generate_fonts():
+    font_dir = os.path.join(projenv.subst("$PROJECT_SRC_DIR"), "display", "fonts")
+    out_dir = os.path.join(projenv.subst("$BUILD_DIR"), "generated")
+
+    for name in FONTS:
+        source = os.path.join(font_dir, name + ".h")
+        out_file = os.path.join(out_dir, name + "_rle.h")
+
+        with open(source) as f:
+            text = encode_font(f.read())
+        if not text:
+            sys.stderr.write("Error: cannot parse the font %s\n" % source)
+            env.Exit(1)
+
+        # Don't touch an unchanged header, so display.cpp isn't rebuilt every time
+        if os.path.isfile(out_file):
+            with open(out_file) as f:
+                if f.read() == text:
+                    continue
+
+        if not os.path.isdir(out_dir):
+            os.makedirs(out_dir)
+        with open(out_file, "w") as f:
+            f.write(text)
+
+
+generate_fonts()
+projenv.Append(CPPPATH=[os.path.join(projenv.subst("$BUILD_DIR"), "generated")])
@@ -0,0 +1,3 @@
+#!/bin/sh
+# Builds the host control loop simulator (see main.cpp for usage)
+cd "$(dirname "$0")" && g++ -std=c++17 -O2 -Wall -Wextra -o pid_model control_core.cpp plant.cpp main.cpp -lm
@@ -0,0 +1,377 @@
+#include "control_core.h"
+
+#include <string.h>
+
+// Same values as in src/includes.h
+#define DEFAULT_VOLTAGE_OFFSET 0
+#define DEFAULT_VOLTAGE_COEFF 24621
+#define DEFAULT_CURRENT_OFFSET -2
+#define DEFAULT_CURRENT_COEFF 12300
+
+namespace sim {
+
+void SControlCore::Reset(const SControlOptions& options)
+{
+    memset(static_cast<void*>(this), 0, sizeof(*this));
+    m_options = options;
+    m_pidKp = DEFAULT_PID_KP;
+    m_pidKi = DEFAULT_PID_KI;
+    m_adcEarlyStartMap = 0xFFFFFF00;
+    m_powerOk = true;
+}
+
+void SControlCore::TimerOverflow(uint16_t adcResult)
+{
+    uint8_t pwmHigh = static_cast<uint8_t>(m_pwmValue >> 8);
+    bool earlyStart = m_gpiorAdcEarlyStart;
+    bool current = m_timerCounter & 0x20;
+
+    // Start the next conversion
+    m_adcChannel = current ? 0 : 1;
+    m_adcEarlyStart = earlyStart;
+
+    if (current)
+    {
+        // Note the quirk: hi >= 0x03 && lo >= 0xE0. It's equal to ">= 0x03E0" only
+        // because the ADC result is 10 bit.
+        bool shortCircuit = (adcResult >> 8) >= (ADC_SHORT_CIRCUIT_VALUE >> 8) &&
+            (adcResult & 0xFF) >= (ADC_SHORT_CIRCUIT_VALUE & 0xFF);
+
+        // The early start section does the dithering after the short circuit check, but
+        // it still uses the PWM high byte loaded at the interrupt start, so OCR0A becomes 0
+        // one interrupt later than in the normal section.
+        if (!earlyStart)
+        {
+            uint16_t sum = (m_pwmValue & 0xFF) + m_pwmLowPos;
+            m_ocr0a = pwmHigh + (sum >> 8);
+            m_pwmLowPos = static_cast<uint8_t>(sum);
+            m_pwmEnabled = m_ocr0a != 0;
+        }
+
+        if (shortCircuit)
+        {
+            m_ocr0a = 0;
+            m_pwmValue = 0;
+            m_gpiorAdcEarlyStart = false;
+            m_pidIntegral = 0;
+        }
+
+        m_adcCurrentAcc += adcResult;
+    }
+    else
+    {
+        if (!earlyStart)
+        {
+            uint16_t sum = (m_pwmValue & 0xFF) + m_pwmLowPos;
+            m_ocr0a = pwmHigh + (sum >> 8);
+            m_pwmLowPos = static_cast<uint8_t>(sum);
+            m_pwmEnabled = m_ocr0a != 0;
+        }
+
+        m_adcVoltageAcc += adcResult;
+    }
+
+    if (earlyStart)
+    {
+        uint16_t sum = (m_pwmValue & 0xFF) + m_pwmLowPos;
+        m_ocr0a = static_cast<uint8_t>(pwmHigh + (sum >> 8));
+        m_pwmLowPos = static_cast<uint8_t>(sum);
+        m_pwmEnabled = true;
+    }
+
+    m_timerCounter += 0x20;
+    if (!(m_timerCounter & (m_options.m_fastPidLoop ? 0x7F : 0xFF)))
+        Timer8th();
+}
+
+void SControlCore::Timer8th()
+{
+    uint16_t adcVoltage = m_adcVoltageAcc;
+    uint16_t adcCurrent = m_adcCurrentAcc;
+
+    // *** Voltage and current 256-sample averager ***
+    m_adcAveragerVoltageAcc = (m_adcAveragerVoltageAcc + adcVoltage) & 0xFFFFFF;
+    m_adcAveragerCurrentAcc = (m_adcAveragerCurrentAcc + adcCurrent) & 0xFFFFFF;
+    m_adcVoltageAcc = 0;
+    m_adcCurrentAcc = 0;
+
+    // PID_FAST_LOOP: only two samples of each kind
+    if (m_options.m_fastPidLoop)
+    {
+        adcVoltage <<= 1;
+        adcCurrent <<= 1;
+    }
+
+    // Fast ADC channel
+    m_adcVoltageFastAcc += adcVoltage - (m_adcVoltageFastAcc >> ADC_FAST_FILTER_SHIFT);
+    m_adcCurrentFastAcc += adcCurrent - (m_adcCurrentFastAcc >> ADC_FAST_FILTER_SHIFT);
+
+    OvercurrentI2t(adcCurrent);
+
+    ++m_pidCycles;
+    if (m_pidMode == PID_MODE_OFF)
+    {
+        // Note that the integral is not reset here
+        SetPwm(0);
+    }
+    else if (m_pidMode == PID_MODE_MANUAL)
+    {
+        if (adcVoltage < m_adcTimingMin)
+            m_adcTimingMin = adcVoltage;
+        if (adcVoltage > m_adcTimingMax)
+            m_adcTimingMax = adcVoltage;
+    }
+    else
+    {
+        Pid(adcVoltage, adcCurrent);
+    }
+
+    if (m_timerCounter)
+        return;
+
+    if (!++m_adcAveragerCounter)
+    {
+        m_adcVoltageAverage = static_cast<uint16_t>(m_adcAveragerVoltageAcc >> 8);
+        m_adcCurrentAverage = static_cast<uint16_t>(m_adcAveragerCurrentAcc >> 8);
+        m_adcAveragerVoltageAcc = 0;
+        m_adcAveragerCurrentAcc = 0;
+    }
+
+    // *** 100 Hz timer ***
+    m_timer625DividerCounter += 8;
+    if (m_timer625DividerCounter & 0x8000)
+        return;
+
+    m_timer625DividerCounter -= 625;
+    ++m_ticks100Hz;
+    CheckForFailures();
+}
+
+void SControlCore::OvercurrentI2t(uint16_t adcCurrent)
+{
+    // PID_FAST_LOOP runs this twice as often, see OVERCURRENT_I2T_CYCLE_* in src/common.h
+    uint32_t trip = m_options.m_fastPidLoop ? OVERCURRENT_I2T_TRIP*2 : OVERCURRENT_I2T_TRIP;
+    uint32_t cooling = m_options.m_fastPidLoop ? OVERCURRENT_I2T_COOLING/2 : OVERCURRENT_I2T_COOLING;
+
+    if (adcCurrent < OVERCURRENT_I2T_START)
+    {
+        m_i2tAcc = m_i2tAcc >= cooling ? m_i2tAcc - cooling : 0;
+        return;
+    }
+
+    // (I^2 - Istart^2)/256 = ((I - Istart)/8)*((I + Istart)/32)
+    uint8_t excess = static_cast<uint8_t>((adcCurrent - OVERCURRENT_I2T_START) >> 3);
+    uint8_t sum = static_cast<uint8_t>((adcCurrent + OVERCURRENT_I2T_START) >> 5);
+    m_i2tAcc += static_cast<uint16_t>(excess)*sum;
+    if (m_i2tAcc >= trip)
+    {
+        m_pidMode = PID_MODE_OFF;
+        m_i2tTripped = true;
+        m_i2tAcc = 0;
+    }
+}
+
+void SControlCore::Pid(uint16_t adcVoltage, uint16_t adcCurrent)
+{
+    uint8_t oldMode = m_pidMode;
+
+    // CDiff = g_pidTargetCurrent - g_adcCurrent
+    uint16_t diff = m_pidTargetCurrent - adcCurrent;
+    if (diff & 0x8000)
+    {
+        m_pidMode = PID_MODE_CC;
+    }
+    else
+    {
+        // VDiff = g_pidTargetVoltage - g_adcVoltage
+        uint16_t vDiff = m_pidTargetVoltage - adcVoltage;
+        if ((vDiff & 0x8000) || m_pidMode != PID_MODE_CC)
+        {
+            m_pidMode = PID_MODE_CV;
+            diff = vDiff << 2;
+        }
+    }
+
+    if (m_pidMode != oldMode)
+        ++m_modeSwitches;
+
+    // diff*gain/128 is calculated as the two high bytes of the 24-bit diff*2*gain product
+    int16_t diff2 = static_cast<int16_t>(diff << 1);
+    int16_t diffKi = static_cast<int16_t>((static_cast<int32_t>(diff2)*m_pidKi) >> 8);
+    int16_t diffKp = static_cast<int16_t>((static_cast<int32_t>(diff2)*m_pidKp) >> 8);
+
+    // PID_FAST_LOOP halves the integral step (asr), the PID runs twice as often
+    if (m_options.m_fastPidLoop)
+        diffKi >>= 1;
+
+    // Limit the PID integral value to [0, 0x020000]
+    uint32_t integral = (m_pidIntegral + static_cast<uint32_t>(static_cast<int32_t>(diffKi))) & 0xFFFFFF;
+    if (integral & 0x800000)
+        integral = 0;
+    else if (integral >= 0x020000)
+        integral = 0x020000;
+
+    m_pidIntegral = integral;
+
+    // PWM = diff*Kp/128 + g_pidIntegral/2
+    uint32_t pwm = static_cast<uint32_t>(static_cast<int32_t>(diffKp)) + (integral >> 1);
+    pwm &= 0xFFFFFF;
+
+    // Limit PWM value to [0, 0xFF00]
+    if (pwm & 0x800000)
+        pwm = 0;
+    else if (pwm >= 0xFF00)
+        pwm = 0xFF00;
+
+    SetPwm(static_cast<uint16_t>(pwm));
+}
+
+void SControlCore::SetPwm(uint16_t pwm)
+{
+    m_pwmValue = pwm;
+    m_gpiorAdcEarlyStart = (m_adcEarlyStartMap & ~static_cast<uint32_t>(1)) >> (pwm >> 11) & 1;
+}
+
+void SControlCore::CheckForFailures()
+{
+    uint8_t failureState = m_failureState;
+
+    // Low power check
+    if (m_powerOk)
+    {
+        m_lowPowerCounter += 5;
+        if (m_lowPowerCounter >= 50)
+        {
+            m_lowPowerCounter = 50;
+            failureState &= ~FAILURE_POWER_LOW;
+        }
+    }
+    else
+    {
+        if (--m_lowPowerCounter < 0)
+        {
+            m_lowPowerCounter = 0;
+            failureState |= FAILURE_POWER_LOW;
+        }
+    }
+
+    uint16_t voltage = m_adcVoltageFastAcc >> ADC_FAST_FILTER_SHIFT;
+    uint16_t current = m_adcCurrentFastAcc >> ADC_FAST_FILTER_SHIFT;
+
+    // Overvoltage check
+    if (static_cast<int16_t>(voltage - m_pidTargetVoltage) > 170 &&
+        static_cast<int16_t>(current - m_pidTargetCurrent) > 50)
+    {
+        if (++m_overvoltageCounter >= 25)
+            failureState |= FAILURE_OVERVOLTAGE;
+    }
+    else
+    {
+        m_overvoltageCounter = 0;
+    }
+
+    // Overcurrent check
+    if (m_i2tTripped)
+    {
+        m_i2tTripped = false;
+        failureState |= FAILURE_OVERCURRENT;
+    }
+
+    if (current > 3072)
+    {
+        if (++m_overcurrentCounter >= 15)
+            failureState |= FAILURE_OVERCURRENT;
+    }
+    else
+    {
+        m_overcurrentCounter = 0;
+    }
+
+    if (failureState & FAILURE_ANY)
+    {
+        m_relayOn = false;
+        m_pidMode = PID_MODE_OFF;
+        m_failureState = failureState & FAILURE_ANY;
+        return;
+    }
+
+    if (failureState & FAILURE_NONE)
+    {
+        if (m_outOn)
+        {
+            if (m_pidMode == PID_MODE_OFF)
+            {
+                // Feed-forward seed for the current output voltage
+                uint16_t seedVoltage = voltage < m_pidTargetVoltage ? voltage : m_pidTargetVoltage;
+                uint32_t pwm = (static_cast<uint32_t>(seedVoltage)*m_pwmPerAdcVoltage) >> 8;
+                if (pwm > 0xFF00)
+                    pwm = 0xFF00;
+
+                // The firmware does this with interrupts disabled, after checking
+                // that the I^2*t protection hasn't tripped since the check above
+                if (!m_i2tTripped)
+                {
+                    if (m_pwmPerAdcVoltage)
+                    {
+                        m_pwmValue = static_cast<uint16_t>(pwm);
+                        m_pidIntegral = pwm << 1;
+                    }
+                    m_pidMode = PID_MODE_CC;
+                }
+            }
+        }
+        else
+        {
+            m_pidMode = PID_MODE_OFF;
+        }
+
+        return;
+    }
+
+    m_relayOn = true;
+    if (++failureState >= 3)
+        failureState = FAILURE_NONE;
+
+    m_failureState = failureState;
+}
+
+// ***
+
+uint16_t DisplayX1000VoltageToAdc(uint16_t x1000Voltage)
+{
+    // Same reciprocal coefficients as SSettings::UpdateConversionCoeffs()
+    constexpr uint16_t coeff = (static_cast<uint32_t>(1) << 28)/DEFAULT_VOLTAGE_COEFF;
+    constexpr uint16_t round = (static_cast<uint32_t>(12000) << 16)/DEFAULT_VOLTAGE_COEFF;
+    int16_t voltage = static_cast<int16_t>((static_cast<uint32_t>(x1000Voltage)*coeff + round) >> 16) -
+        DEFAULT_VOLTAGE_OFFSET;
+    return voltage < 0 ? 0 : voltage;
+}
+
+uint16_t DisplayX1000CurrentToAdc(uint16_t x1000Current)
+{
+    constexpr uint16_t coeff = (static_cast<uint32_t>(1) << 28)/DEFAULT_CURRENT_COEFF;
+    constexpr uint16_t round = (static_cast<uint32_t>(6000) << 16)/DEFAULT_CURRENT_COEFF;
+    int16_t current = static_cast<int16_t>((static_cast<uint32_t>(x1000Current)*coeff + round) >> 16) -
+        DEFAULT_CURRENT_OFFSET;
+    return current < 0 ? 0 : current;
+}
+
+uint16_t AdcVoltageToDisplayX1000(uint16_t adcVoltage)
+{
+    int16_t voltage = static_cast<int16_t>(adcVoltage) + DEFAULT_VOLTAGE_OFFSET;
+    if (voltage < 0)
+        voltage = 0;
+
+    return (static_cast<uint32_t>(voltage)*DEFAULT_VOLTAGE_COEFF + 2048) >> 12;
+}
+
+uint16_t AdcCurrentToDisplayX1000(uint16_t adcCurrent)
+{
+    int16_t current = static_cast<int16_t>(adcCurrent) + DEFAULT_CURRENT_OFFSET;
+    if (current < 0)
+        current = 0;
+
+    return (static_cast<uint32_t>(current)*DEFAULT_CURRENT_COEFF + 2048) >> 12;
+}
+
+} // namespace sim
@@ -0,0 +1,147 @@
+// Host reference model of the charger control core.
+//
+// This is a bit-exact C++ copy of the integer arithmetic done by the timer 0 interrupt
+// (src/timer_int.S: ADC sampling, PWM dithering, short circuit and I^2*t protection, the fast
+// ADC channel, PID and the 256-sample averager) and of CheckForFailures() (src/main.cpp). If you change any of
+// these routines in the firmware, change them here too, otherwise the model is useless.
+
+#pragma once
+
+#include <stdint.h>
+
+// Same values as in src/common.h
+#define ADC_SHORT_CIRCUIT_VALUE 0x03E0
+#define ADC_FAST_FILTER_SHIFT 3
+#define OVERCURRENT_I2T_START 3072
+#define OVERCURRENT_I2T_TRIP 0x080000
+#define OVERCURRENT_I2T_COOLING 2048
+
+#define PID_MODE_OFF 0x00
+#define PID_MODE_CV 0x01
+#define PID_MODE_CC 0x02
+#define PID_MODE_MANUAL 0x03
+
+// Same values as in src/includes.h
+#define DEFAULT_PID_KP 32
+#define DEFAULT_PID_KI 64
+
+// Same values as in src/data.h
+#define FAILURE_NONE 0x10
+#define FAILURE_POWER_LOW 0x20
+#define FAILURE_OVERVOLTAGE 0x40
+#define FAILURE_OVERCURRENT 0x80
+#define FAILURE_ANY (FAILURE_POWER_LOW | FAILURE_OVERVOLTAGE | FAILURE_OVERCURRENT)
+
+namespace sim {
+
+// Firmware build options
+struct SControlOptions
+{
+    // PID_FAST_LOOP
+    bool m_fastPidLoop = false;
+};
+
+struct SControlCore
+{
+    SControlOptions m_options;
+
+    // *** Firmware globals (see src/data.h) ***
+
+    uint8_t m_timerCounter;
+    uint16_t m_timer625DividerCounter;
+    uint16_t m_pwmValue;
+    uint8_t m_pwmLowPos;
+    uint16_t m_adcVoltageAcc;
+    uint16_t m_adcCurrentAcc;
+
+    // 24 bit
+    uint32_t m_pidIntegral;
+    uint8_t m_pidMode;
+    uint16_t m_pidTargetVoltage;
+    uint16_t m_pidTargetCurrent;
+    uint8_t m_pidKp;
+    uint8_t m_pidKi;
+
+    // SSettings::m_pwmPerAdcVoltage, 8.8 fixed point (0 - no feed-forward)
+    uint16_t m_pwmPerAdcVoltage;
+
+    // Early ADC start map (bit 0 is cleared as SSettings::ApplyAdcEarlyStartMap() does)
+    uint32_t m_adcEarlyStartMap;
+
+    // Voltage sample range in the PID_MODE_MANUAL mode
+    uint16_t m_adcTimingMin;
+    uint16_t m_adcTimingMax;
+
+    // Averager, accumulators are 24 bit
+    uint8_t m_adcAveragerCounter;
+    uint32_t m_adcAveragerVoltageAcc;
+    uint32_t m_adcAveragerCurrentAcc;
+    uint16_t m_adcVoltageAverage;
+    uint16_t m_adcCurrentAverage;
+
+    // Fast channel IIR filter accumulators
+    uint16_t m_adcVoltageFastAcc;
+    uint16_t m_adcCurrentFastAcc;
+
+    // I^2*t overcurrent protection, the accumulator is 24 bit
+    uint32_t m_i2tAcc;
+    bool m_i2tTripped;
+
+    bool m_outOn;
+    uint8_t m_failureState;
+
+    // CheckForFailures() static counters
+    int8_t m_lowPowerCounter;
+    int8_t m_overvoltageCounter;
+    int8_t m_overcurrentCounter;
+
+    // *** MCU peripherals ***
+
+    // OCR0A and the OC0A output enable (COM0A1 bit of TCCR0A)
+    uint8_t m_ocr0a;
+    bool m_pwmEnabled;
+
+    // ADC channel being converted (0 - voltage, 1 - current) and whether the
+    // last conversion was started by the early start section
+    uint8_t m_adcChannel;
+    bool m_adcEarlyStart;
+
+    // GPIOR0_ADC_EARLY_START
+    bool m_gpiorAdcEarlyStart;
+
+    // Output relay (PD_RELAY) and the PC_IN_POWER_OK input
+    bool m_relayOn;
+    bool m_powerOk;
+
+    // *** Model statistics ***
+
+    // Number of the PID cycles and of the PID CV <-> CC mode switches
+    uint32_t m_pidCycles;
+    uint32_t m_modeSwitches;
+
+    // Number of the 100 Hz timer ticks
+    uint32_t m_ticks100Hz;
+
+    void Reset(const SControlOptions& options);
+
+    // Timer 0 overflow interrupt. 'adcResult' is the result of the conversion started
+    // in the previous interrupt (of the m_adcChannel channel).
+    void TimerOverflow(uint16_t adcResult);
+
+    // Copy of CheckForFailures() from src/main.cpp
+    void CheckForFailures();
+
+private:
+    void Timer8th();
+    void OvercurrentI2t(uint16_t adcCurrent);
+    void Pid(uint16_t adcVoltage, uint16_t adcCurrent);
+    void SetPwm(uint16_t pwm);
+};
+
+// Copies of the SSettings conversion routines with the default calibration values
+uint16_t DisplayX1000VoltageToAdc(uint16_t x1000Voltage);
+uint16_t DisplayX1000CurrentToAdc(uint16_t x1000Current);
+uint16_t AdcVoltageToDisplayX1000(uint16_t adcVoltage);
+uint16_t AdcCurrentToDisplayX1000(uint16_t adcCurrent);
+
+} // namespace sim
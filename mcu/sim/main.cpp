@@ -0,0 +1,727 @@
+// Charger control loop simulator.
+//
+// Runs the bit-exact model of the firmware control core (control_core.cpp) against the
+// output stage model (plant.cpp) and measures the loop step response: rise time,
+// overshoot, settling time, steady state error and CV/CC mode flapping.
+//
+// Usage: pid_model [options] [scenario ...]
+//     --list          list scenarios
+//     --csv <file>    write the trace of the (last) scenario to a CSV file
+//     --fast-loop     PID_FAST_LOOP firmware build option
+//     --feed-forward  learn the feed-forward PWM ratio (as the calibration screen does)
+//                     and seed the PID with it
+//     --kp <gain>     PID proportional gain, 1.7 fixed point (default 32)
+//     --ki <gain>     PID integral gain, 1.7 fixed point (default 64)
+//     --noise <lsb>   RMS ADC noise, in LSBs (default 0)
+//     --vin <volts>   input voltage (default 28)
+//
+// The exit code is 1 if a step response hasn't settled, hasn't converged to its target or
+// oscillates.
+
+#include "control_core.h"
+#include "plant.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace sim {
+
+// Timer 0 period
+#define PWM_PERIOD (256/16000000.0)
+
+// CPU clock in the PWM period when the ADC samples its input: conversions are started
+// 43 (normal) or 27 (early start) clocks after the interrupt and the sample and hold
+// takes 1.5 ADC clocks (24 CPU clocks). Plus 4 clocks of the interrupt response time.
+#define ADC_SAMPLE_CLOCK_NORMAL (4 + 43 + 24)
+#define ADC_SAMPLE_CLOCK_EARLY (4 + 27 + 24)
+
+// Trace record, one per PID cycle
+struct STracePoint
+{
+    double m_time;
+
+    // Averages over the PID cycle
+    double m_vOut;
+    double m_iOut;
+
+    uint16_t m_pwmValue;
+    uint32_t m_pidIntegral;
+    uint8_t m_pidMode;
+};
+
+class CSimulator
+{
+public:
+    SControlCore m_core;
+    CPlant m_plant;
+    std::vector<STracePoint> m_trace;
+
+    CSimulator(const SPlantParams& params, const SControlOptions& options)
+    {
+        m_core.Reset(options);
+        m_plant.m_params = params;
+        m_plant.Reset();
+    }
+
+    double Time() const
+    {
+        return m_periods*PWM_PERIOD;
+    }
+
+    // Sets the PID targets the same way the UI does
+    void SetTargets(uint16_t x1000Voltage, uint16_t x1000Current)
+    {
+        m_core.m_pidTargetVoltage = DisplayX1000VoltageToAdc(x1000Voltage);
+        m_core.m_pidTargetCurrent = DisplayX1000CurrentToAdc(x1000Current);
+    }
+
+    void Run(double seconds)
+    {
+        double end = Time() + seconds;
+        while (Time() < end)
+        {
+            // The OCR0A value written by the interrupt is applied at the next BOTTOM,
+            // so the period always uses the value calculated in the previous interrupt
+            uint16_t adcSampleClock = m_core.m_adcEarlyStart ? ADC_SAMPLE_CLOCK_EARLY : ADC_SAMPLE_CLOCK_NORMAL;
+            uint16_t adcResult = m_plant.RunPwmPeriod(m_core.m_ocr0a, m_core.m_pwmEnabled, m_core.m_relayOn,
+                m_core.m_adcChannel, adcSampleClock);
+            ++m_periods;
+
+            m_vSum += m_plant.m_vOutAverage;
+            m_iSum += m_plant.m_iOutAverage;
+            ++m_sumCount;
+
+            uint32_t pidCycles = m_core.m_pidCycles;
+            m_core.TimerOverflow(adcResult);
+            if (m_core.m_pidCycles != pidCycles)
+            {
+                m_trace.push_back({Time(), m_vSum/m_sumCount, m_iSum/m_sumCount, m_core.m_pwmValue,
+                    m_core.m_pidIntegral, m_core.m_pidMode});
+                m_vSum = m_iSum = 0;
+                m_sumCount = 0;
+            }
+        }
+    }
+
+private:
+    uint64_t m_periods = 0;
+    double m_vSum = 0;
+    double m_iSum = 0;
+    uint8_t m_sumCount = 0;
+};
+
+// ***
+
+struct SStepMetrics
+{
+    double m_initial;
+    double m_final;
+    double m_riseTime;
+    double m_overshoot;
+    double m_settlingTime;
+    double m_steadyStateError;
+    double m_ripple;
+    uint32_t m_modeSwitches;
+    uint32_t m_modeSwitchesSettled;
+};
+
+// Limits of the step response checks. The loop has integral action, so the output must end
+// within 1% of the target, or within two ADC LSBs of it (25 mA / 50 mV, the model doesn't
+// have the calibration offsets).
+double ErrorLimit(double target, bool current)
+{
+    return fmax(fabs(target)*0.01, current ? 0.025 : 0.05);
+}
+
+// A limit cycle shows up as the peak-to-peak ripple, which must stay within 10% of the target
+// or eight ADC LSBs. The PWM dithering alone moves the current of a low resistance battery
+// by a few LSBs.
+double RippleLimit(double target, bool current)
+{
+    return fmax(fabs(target)*0.1, current ? 0.1 : 0.2);
+}
+
+// Step response of the output voltage (current = false) or current (current = true) in
+// the trace window [start, end) to the target value. The settling band is 2% of the step,
+// but not narrower than the half of the ripple limit.
+SStepMetrics MeasureStep(const std::vector<STracePoint>& trace, double start, double end,
+    bool current, double target)
+{
+    SStepMetrics m = {};
+    m.m_riseTime = m.m_settlingTime = m.m_steadyStateError = NAN;
+
+    size_t first = 0;
+    while (first < trace.size() && trace[first].m_time < start)
+        ++first;
+
+    size_t last = first;
+    while (last < trace.size() && trace[last].m_time < end)
+        ++last;
+
+    if (last - first < 16)
+        return m;
+
+    auto value = [&](size_t i) { return current ? trace[i].m_iOut : trace[i].m_vOut; };
+
+    m.m_initial = value(first);
+    double step = target - m.m_initial;
+    double band = fmax(fabs(step)*0.02, RippleLimit(target, current)/2);
+
+    double t10 = NAN, t90 = NAN;
+    double peak = m.m_initial;
+    size_t settledAt = first;
+    for (size_t i = first; i < last; ++i)
+    {
+        double v = value(i);
+        double progress = step != 0 ? (v - m.m_initial)/step : 1;
+        if (isnan(t10) && progress >= 0.1)
+            t10 = trace[i].m_time;
+        if (isnan(t90) && progress >= 0.9)
+            t90 = trace[i].m_time;
+
+        if ((step >= 0 && v > peak) || (step < 0 && v < peak))
+            peak = v;
+
+        if (fabs(v - target) > band)
+            settledAt = i + 1;
+
+        if (i > first && trace[i].m_pidMode != trace[i - 1].m_pidMode)
+            ++m.m_modeSwitches;
+    }
+
+    m.m_riseTime = t90 - t10;
+    m.m_overshoot = step != 0 ? fmax(0, (peak - target)/step*100) : 0;
+    if (settledAt < last)
+        m.m_settlingTime = trace[settledAt].m_time - start;
+
+    for (size_t i = settledAt + 1; i < last; ++i)
+    {
+        if (trace[i].m_pidMode != trace[i - 1].m_pidMode)
+            ++m.m_modeSwitchesSettled;
+    }
+
+    // Final value, error and peak-to-peak ripple over the last 10% of the window
+    size_t tail = last - (last - first)/10;
+    double sum = 0, minValue = value(tail), maxValue = value(tail);
+    for (size_t i = tail; i < last; ++i)
+    {
+        sum += value(i);
+        minValue = fmin(minValue, value(i));
+        maxValue = fmax(maxValue, value(i));
+    }
+
+    m.m_final = sum/(last - tail);
+    m.m_steadyStateError = m.m_final - target;
+    m.m_ripple = maxValue - minValue;
+    return m;
+}
+
+struct SDisturbanceMetrics
+{
+    double m_peakDeviation;
+    double m_recoveryTime;
+};
+
+// Disturbance rejection: the worst deviation from the target value in the trace window
+// [start, end) and the time to get back to the +/-1% band around the target (NAN if the
+// output is still out of the band at the window end)
+SDisturbanceMetrics MeasureDisturbance(const std::vector<STracePoint>& trace, double start, double end,
+    bool current, double target)
+{
+    SDisturbanceMetrics m = {0, 0};
+    double band = fabs(target)*0.01;
+    bool recovered = true;
+    for (const STracePoint& p : trace)
+    {
+        if (p.m_time < start || p.m_time >= end)
+            continue;
+
+        double deviation = (current ? p.m_iOut : p.m_vOut) - target;
+        if (fabs(deviation) > fabs(m.m_peakDeviation))
+            m.m_peakDeviation = deviation;
+
+        recovered = fabs(deviation) <= band;
+        if (!recovered)
+            m.m_recoveryTime = p.m_time - start;
+    }
+
+    if (!recovered)
+        m.m_recoveryTime = NAN;
+
+    return m;
+}
+
+// Set by the scenario checks, main() returns 1 then
+static bool s_failed = false;
+
+// A step response must settle, end within the error limit and have no limit cycle (see
+// ErrorLimit() and RippleLimit()). Fails the run otherwise.
+void CheckConverged(const char* name, const SStepMetrics& m, bool current)
+{
+    double target = m.m_final - m.m_steadyStateError;
+    if (isnan(m.m_settlingTime))
+    {
+        printf("  FAILED: %s hasn't settled\n", name);
+        s_failed = true;
+    }
+
+    if (!(fabs(m.m_steadyStateError) <= ErrorLimit(target, current)))
+    {
+        printf("  FAILED: %s hasn't converged to the target\n", name);
+        s_failed = true;
+    }
+
+    if (!(m.m_ripple <= RippleLimit(target, current)))
+    {
+        printf("  FAILED: %s oscillates\n", name);
+        s_failed = true;
+    }
+}
+
+void PrintStep(const char* name, const SStepMetrics& m, bool current)
+{
+    const char* unit = current ? "A" : "V";
+    printf("  %s: %.3f -> %.3f %s\n", name, m.m_initial, m.m_final, unit);
+    printf("    rise time (10-90%%)  %8.2f ms\n", m.m_riseTime*1000);
+    printf("    overshoot           %8.2f %%\n", m.m_overshoot);
+    printf("    settling time (2%%)  %8.2f ms\n", m.m_settlingTime*1000);
+    printf("    steady state error  %8.4f %s\n", m.m_steadyStateError, unit);
+    printf("    ripple (p-p)        %8.4f %s\n", m.m_ripple, unit);
+    printf("    CV/CC switches      %8u (%u after settling)\n", m.m_modeSwitches, m.m_modeSwitchesSettled);
+    CheckConverged(name, m, current);
+}
+
+void PrintDisturbance(const char* name, const SDisturbanceMetrics& m, bool current)
+{
+    printf("  %s:\n", name);
+    printf("    peak deviation      %8.4f %s\n", m.m_peakDeviation, current ? "A" : "V");
+    if (isnan(m.m_recoveryTime))
+        printf("    recovery time (1%%)  not recovered\n");
+    else
+        printf("    recovery time (1%%)  %8.2f ms\n", m.m_recoveryTime*1000);
+}
+
+// *** Scenarios ***
+
+// Power supply mode, 12 V / 3 A into 20 Ohm
+void ScenarioCvStep(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Resistor;
+    s.m_plant.m_load.m_resistance = 20;
+    s.SetTargets(12000, 3000);
+    s.m_core.m_outOn = true;
+    s.Run(0.2);
+
+    PrintStep("output on, 12 V into 20 Ohm", MeasureStep(s.m_trace, 0, 0.2, false, 12.0), false);
+}
+
+// Power supply mode, 12 V / 2 A into 2 Ohm (current limited)
+void ScenarioCcStep(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Resistor;
+    s.m_plant.m_load.m_resistance = 2;
+    s.SetTargets(12000, 2000);
+    s.m_core.m_outOn = true;
+    s.Run(0.2);
+
+    PrintStep("output on, 2 A into 2 Ohm", MeasureStep(s.m_trace, 0, 0.2, true, 2.0), true);
+}
+
+// Power supply mode, 12 V, load steps from 20 Ohm to 6 Ohm and back
+void ScenarioLoadStep(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Resistor;
+    s.m_plant.m_load.m_resistance = 20;
+    s.SetTargets(12000, 3000);
+    s.m_core.m_outOn = true;
+    s.Run(0.2);
+
+    s.m_plant.m_load.m_resistance = 6;
+    s.Run(0.1);
+    s.m_plant.m_load.m_resistance = 20;
+    s.Run(0.1);
+
+    PrintDisturbance("load 0.6 A -> 2 A", MeasureDisturbance(s.m_trace, 0.2, 0.3, false, 12.0), false);
+    PrintDisturbance("load 2 A -> 0.6 A", MeasureDisturbance(s.m_trace, 0.3, 0.4, false, 12.0), false);
+}
+
+// Power supply mode, 12 V / 2 A: overload to 3 Ohm (current limit) and back to 20 Ohm
+void ScenarioCurrentLimit(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Resistor;
+    s.m_plant.m_load.m_resistance = 20;
+    s.SetTargets(12000, 2000);
+    s.m_core.m_outOn = true;
+    s.Run(0.2);
+
+    s.m_plant.m_load.m_resistance = 3;
+    s.Run(0.2);
+    s.m_plant.m_load.m_resistance = 20;
+    s.Run(0.2);
+
+    PrintDisturbance("overload, CV -> CC", MeasureDisturbance(s.m_trace, 0.2, 0.4, true, 2.0), true);
+    PrintDisturbance("overload removed, CC -> CV", MeasureDisturbance(s.m_trace, 0.4, 0.6, false, 12.0), false);
+}
+
+// Power supply mode, 5 V: 2 A load is disconnected and connected back. The output
+// overshoots on disconnection and the PWM is saturated at 0 for a while.
+void ScenarioLoadDump(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Resistor;
+    s.m_plant.m_load.m_resistance = 2.5;
+    s.SetTargets(5000, 3000);
+    s.m_core.m_outOn = true;
+    s.Run(0.2);
+
+    s.m_plant.m_load.m_type = ELoad::Open;
+    s.Run(0.1);
+    s.m_plant.m_load.m_type = ELoad::Resistor;
+    s.Run(0.1);
+
+    PrintDisturbance("load 2 A -> open", MeasureDisturbance(s.m_trace, 0.2, 0.3, false, 5.0), false);
+    PrintDisturbance("load open -> 2 A", MeasureDisturbance(s.m_trace, 0.3, 0.4, false, 5.0), false);
+}
+
+// Charger mode, Makita 18V profile: the 10-second measurement cycle. The output is
+// switched off for 100 ms to measure the battery voltage and then back on.
+void ScenarioChargeCycle(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Battery;
+    s.m_plant.m_load.m_ocv = 18.0;
+    s.m_plant.m_vCap = 18.0;
+    s.SetTargets(21000, 2000);
+    s.m_core.m_outOn = true;
+    s.Run(0.5);
+
+    s.m_core.m_outOn = false;
+    s.Run(0.1);
+    s.m_core.m_outOn = true;
+    s.Run(0.3);
+
+    PrintStep("output back on, 2 A", MeasureStep(s.m_trace, 0.6, 0.9, true, 2.0), true);
+}
+
+// Charger mode, Makita 18V profile: no-battery output values, battery connection,
+// then the working output values (21 V / 2 A)
+void ScenarioCharge(CSimulator& s)
+{
+    s.SetTargets(21000, 30 + AdcCurrentToDisplayX1000(0));
+    s.m_core.m_outOn = true;
+    s.Run(2.0);
+
+    s.m_plant.m_load.m_type = ELoad::Battery;
+    s.m_plant.m_load.m_ocv = 18.0;
+    s.Run(0.1);
+
+    s.SetTargets(21000, 2000);
+    s.Run(0.3);
+
+    PrintStep("open voltage", MeasureStep(s.m_trace, 0, 2.0, false, 21.0), false);
+    PrintStep("charge current 2 A", MeasureStep(s.m_trace, 2.1, 2.4, true, 2.0), true);
+}
+
+// Charger mode, Li-Ion 1S 4.2V 1.5A profile, 2 A charge start
+void ScenarioCharge1S(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Battery;
+    s.m_plant.m_load.m_ocv = 3.6;
+    s.m_plant.m_load.m_ocvPerAh = 0.5;
+    s.m_plant.m_load.m_rInternal = 0.04;
+    s.m_plant.m_vCap = 3.6;
+    s.SetTargets(4200, 1500);
+    s.m_core.m_outOn = true;
+    s.Run(0.3);
+
+    PrintStep("charge current 1.5 A", MeasureStep(s.m_trace, 0, 0.3, true, 1.5), true);
+}
+
+// Charger mode, Li-Ion 2S 8.4V 1.5A profile, 1.5 A charge start
+void ScenarioCharge2S(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Battery;
+    s.m_plant.m_load.m_ocv = 7.2;
+    s.m_plant.m_load.m_ocvPerAh = 1.0;
+    s.m_plant.m_load.m_rInternal = 0.08;
+    s.m_plant.m_vCap = 7.2;
+    s.SetTargets(8400, 1500);
+    s.m_core.m_outOn = true;
+    s.Run(0.3);
+
+    PrintStep("charge current 1.5 A", MeasureStep(s.m_trace, 0, 0.3, true, 1.5), true);
+}
+
+// Charger mode, Li 6F22 8.4V 0.3A profile (a 9 V size Li-Ion battery with a high
+// internal resistance), 0.3 A charge start
+void ScenarioCharge6F22(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Battery;
+    s.m_plant.m_load.m_ocv = 7.4;
+    s.m_plant.m_load.m_ocvPerAh = 2.0;
+    s.m_plant.m_load.m_rInternal = 1.0;
+    s.m_plant.m_vCap = 7.4;
+    s.SetTargets(8400, 300);
+    s.m_core.m_outOn = true;
+    s.Run(0.3);
+
+    PrintStep("charge current 0.3 A", MeasureStep(s.m_trace, 0, 0.3, true, 0.3), true);
+}
+
+// Charger mode near the end of the CC phase: the battery voltage at 2 A is just
+// at the CV threshold, so the loop may flap between CV and CC
+void ScenarioCcCv(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Battery;
+    s.m_plant.m_load.m_ocv = 20.82;
+    s.m_plant.m_vCap = 20.82;
+    s.SetTargets(21000, 2000);
+    s.m_core.m_outOn = true;
+    s.Run(1.0);
+
+    PrintStep("CC/CV border", MeasureStep(s.m_trace, 0, 1.0, false, 21.0), false);
+}
+
+// Runs the simulation for 'seconds' and returns the time from the start to the moment the
+// output is switched off by the overcurrent protection (NAN if it wasn't). CheckForFailures()
+// signals the failure up to 10 ms later if the I^2*t protection has tripped.
+double RunUntilOvercurrent(CSimulator& s, double seconds)
+{
+    double start = s.Time();
+    double end = start + seconds;
+    while (s.Time() < end)
+    {
+        s.Run(0.0001);
+        if (s.m_core.m_i2tTripped || (s.m_core.m_failureState & FAILURE_OVERCURRENT))
+            return s.Time() - start;
+    }
+
+    return NAN;
+}
+
+// Peak output current in the trace window [start, end)
+double PeakCurrent(const std::vector<STracePoint>& trace, double start, double end)
+{
+    double peak = 0;
+    for (const STracePoint& p : trace)
+    {
+        if (p.m_time >= start && p.m_time < end)
+            peak = fmax(peak, p.m_iOut);
+    }
+
+    return peak;
+}
+
+// Power supply mode, 12 V / 8 A: a 3 Ohm -> 1 Ohm load step must be handled by the current
+// limit without a trip. Then the current target is set above the protection threshold (as a
+// regulation fault would do), the protection must switch the output off.
+void ScenarioOvercurrent(CSimulator& s)
+{
+    s.m_plant.m_load.m_type = ELoad::Resistor;
+    s.m_plant.m_load.m_resistance = 3;
+    s.SetTargets(12000, 8000);
+    s.m_core.m_outOn = true;
+    s.Run(0.2);
+
+    s.m_plant.m_load.m_resistance = 1;
+    double tripTime = RunUntilOvercurrent(s, 0.2);
+    printf("  load 4 A -> 1 Ohm (8 A limit):\n");
+    printf("    peak current        %8.4f A\n", PeakCurrent(s.m_trace, 0.2, 0.4));
+    printf("    overcurrent trip    %8.2f ms\n", tripTime*1000);
+
+    static const double s_faultCurrents[] = {9.5, 10.0, 11.0};
+    for (double current : s_faultCurrents)
+    {
+        s.SetTargets(12000, static_cast<uint16_t>(current*1000));
+        double start = s.Time();
+        tripTime = RunUntilOvercurrent(s, 0.5);
+        printf("  regulation fault, %.1f A:\n", current);
+        printf("    peak current        %8.4f A\n", PeakCurrent(s.m_trace, start, s.Time()));
+        printf("    overcurrent trip    %8.2f ms\n", tripTime*1000);
+
+        // Clear the failure the way the failure message box does and let the output recover
+        s.Run(0.02);
+        s.m_core.m_failureState &= ~FAILURE_OVERCURRENT;
+        s.SetTargets(12000, 8000);
+        s.Run(0.2);
+    }
+}
+
+struct SScenario
+{
+    const char* m_name;
+    const char* m_description;
+    void (*m_run)(CSimulator& s);
+};
+
+static const SScenario s_scenarios[] =
+{
+    {"cv-step", "power supply 12 V into 20 Ohm, voltage step response", ScenarioCvStep},
+    {"cc-step", "power supply 2 A into 2 Ohm, current step response", ScenarioCcStep},
+    {"load-step", "power supply 12 V, 0.6 A <-> 2 A load steps", ScenarioLoadStep},
+    {"current-limit", "power supply 12 V / 2 A, 0.6 A -> overload -> 0.6 A", ScenarioCurrentLimit},
+    {"load-dump", "power supply 5 V, 2 A load disconnection and reconnection", ScenarioLoadDump},
+    {"charge-cycle", "charger, 2 A charge, output off/on for the voltage measurement", ScenarioChargeCycle},
+    {"charge", "charger, open voltage, battery connection and 2 A charge", ScenarioCharge},
+    {"charge-1s", "charger, 1S Li-Ion cell, 1.5 A charge start", ScenarioCharge1S},
+    {"charge-2s", "charger, 2S Li-Ion battery, 1.5 A charge start", ScenarioCharge2S},
+    {"charge-6f22", "charger, 6F22 size Li-Ion battery, 0.3 A charge start", ScenarioCharge6F22},
+    {"cc-cv", "charger, battery at the CC/CV border (mode flapping)", ScenarioCcCv},
+    {"overcurrent", "power supply 12 V / 8 A, current limit and I^2*t protection trips", ScenarioOvercurrent},
+};
+
+void WriteCsv(const char* fileName, const std::vector<STracePoint>& trace)
+{
+    FILE* f = fopen(fileName, "w");
+    if (!f)
+    {
+        fprintf(stderr, "Cannot create %s\n", fileName);
+        exit(1);
+    }
+
+    fprintf(f, "time,vout,iout,pwm,integral,mode\n");
+    for (const STracePoint& p : trace)
+    {
+        fprintf(f, "%.6f,%.4f,%.4f,%u,%u,%u\n", p.m_time, p.m_vOut, p.m_iOut,
+            p.m_pwmValue, p.m_pidIntegral, p.m_pidMode);
+    }
+
+    fclose(f);
+}
+
+// Learns SSettings::m_pwmPerAdcVoltage the same way the calibration screen does:
+// 23.5 V in the CV mode (into 20 Ohm), the PWM value is averaged over 16 samples
+// taken every 10 ms
+uint16_t LearnFeedForward(const SPlantParams& params, const SControlOptions& options)
+{
+    CSimulator s(params, options);
+    s.m_plant.m_load.m_type = ELoad::Resistor;
+    s.m_plant.m_load.m_resistance = 20;
+    s.SetTargets(23500, 6000);
+    s.m_core.m_outOn = true;
+    s.Run(0.5);
+
+    uint32_t pwmSum = 0;
+    for (uint8_t i = 0; i < 16; ++i)
+    {
+        s.Run(0.01);
+        pwmSum += s.m_core.m_pwmValue;
+    }
+
+    return static_cast<uint16_t>((pwmSum << 4)/s.m_core.m_pidTargetVoltage);
+}
+
+} // namespace sim
+
+int main(int argc, char** argv)
+{
+    using namespace sim;
+
+    SPlantParams params;
+    SControlOptions options;
+    uint8_t gainKp = DEFAULT_PID_KP;
+    uint8_t gainKi = DEFAULT_PID_KI;
+    bool feedForward = false;
+    const char* csvFileName = nullptr;
+    std::vector<const SScenario*> scenarios;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--list"))
+        {
+            for (const SScenario& scenario : s_scenarios)
+                printf("%-10s %s\n", scenario.m_name, scenario.m_description);
+
+            return 0;
+        }
+
+        if (!strcmp(argv[i], "--csv") && i + 1 < argc)
+        {
+            csvFileName = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--fast-loop"))
+        {
+            options.m_fastPidLoop = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--feed-forward"))
+        {
+            feedForward = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--kp") && i + 1 < argc)
+        {
+            gainKp = static_cast<uint8_t>(atoi(argv[++i]));
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--ki") && i + 1 < argc)
+        {
+            gainKi = static_cast<uint8_t>(atoi(argv[++i]));
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--noise") && i + 1 < argc)
+        {
+            params.m_adcNoise = atof(argv[++i]);
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--vin") && i + 1 < argc)
+        {
+            params.m_vIn = atof(argv[++i]);
+            continue;
+        }
+
+        const SScenario* found = nullptr;
+        for (const SScenario& scenario : s_scenarios)
+        {
+            if (!strcmp(argv[i], scenario.m_name))
+                found = &scenario;
+        }
+
+        if (!found)
+        {
+            fprintf(stderr, "Unknown scenario or option: %s (try --list)\n", argv[i]);
+            return 1;
+        }
+
+        scenarios.push_back(found);
+    }
+
+    if (scenarios.empty())
+    {
+        for (const SScenario& scenario : s_scenarios)
+            scenarios.push_back(&scenario);
+    }
+
+    uint16_t pwmPerAdcVoltage = 0;
+    if (feedForward)
+    {
+        pwmPerAdcVoltage = LearnFeedForward(params, options);
+        printf("Learned feed-forward PWM ratio: %u (%.3f PWM per ADC voltage unit)\n\n",
+            pwmPerAdcVoltage, pwmPerAdcVoltage/256.0);
+    }
+
+    for (const SScenario* scenario : scenarios)
+    {
+        printf("%s: %s\n", scenario->m_name, scenario->m_description);
+
+        CSimulator s(params, options);
+        s.m_core.m_pidKp = gainKp;
+        s.m_core.m_pidKi = gainKi;
+        s.m_core.m_pwmPerAdcVoltage = pwmPerAdcVoltage;
+        scenario->m_run(s);
+        printf("\n");
+
+        if (csvFileName)
+            WriteCsv(csvFileName, s.m_trace);
+    }
+
+    return s_failed ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+#include "plant.h"
+
+#include <math.h>
+
+// CPU clock and the number of CPU clocks per integration step
+#define F_CPU 16000000.0
+#define CLOCKS_PER_STEP 4
+
+namespace sim {
+
+void CPlant::Reset()
+{
+    m_iL = 0;
+    m_vCap = 0;
+    m_vOut = 0;
+    m_vPolarization = 0;
+    m_chargeAh = 0;
+    m_iOut = 0;
+    m_vOutAverage = 0;
+    m_iOutAverage = 0;
+    m_vAdc = 0;
+    m_iAdc = 0;
+    m_random = 1;
+}
+
+uint16_t CPlant::RunPwmPeriod(uint8_t ocr0a, bool pwmEnabled, bool relayOn,
+    uint8_t adcChannel, uint16_t adcSampleClock)
+{
+    // Fast PWM, non-inverting: OC0A is high from BOTTOM to the compare match
+    uint16_t onClocks = pwmEnabled ? ocr0a + 1 : 0;
+    double dt = CLOCKS_PER_STEP/F_CPU;
+
+    double sample = 0;
+    double vSum = 0, iSum = 0;
+    for (uint16_t clock = 0; clock < 256; clock += CLOCKS_PER_STEP)
+    {
+        if (clock == (adcSampleClock & ~(CLOCKS_PER_STEP - 1)))
+            sample = adcChannel ? m_iAdc/m_params.m_adcCurrentScale : m_vAdc/m_params.m_adcVoltageScale;
+
+        Step(clock < onClocks, relayOn, dt);
+        vSum += m_vOut;
+        iSum += m_iOut;
+    }
+
+    m_vOutAverage = vSum*CLOCKS_PER_STEP/256;
+    m_iOutAverage = iSum*CLOCKS_PER_STEP/256;
+
+    double value = floor(sample*1023 + 0.5 + Noise());
+    if (value < 0)
+        value = 0;
+    if (value > 1023)
+        value = 1023;
+
+    return static_cast<uint16_t>(value);
+}
+
+void CPlant::Step(bool switchOn, bool relayOn, double dt)
+{
+    const SPlantParams& p = m_params;
+
+    // The load is a conductance with a voltage source (battery open circuit voltage)
+    double g = 0, e = 0;
+    if (relayOn)
+    {
+        if (m_load.m_type == ELoad::Resistor)
+        {
+            g = 1/(m_load.m_resistance + p.m_rWires);
+        }
+        else if (m_load.m_type == ELoad::Battery)
+        {
+            g = 1/(m_load.m_rInternal + p.m_rWires);
+            e = m_load.m_ocv + m_load.m_ocvPerAh*m_chargeAh + m_vPolarization;
+        }
+    }
+
+    // Output voltage: the capacitor voltage plus the voltage across its ESR
+    m_vOut = (m_vCap + p.m_esr*(m_iL + e*g))/(1 + p.m_esr*(g + 1/p.m_rBleed));
+    m_iOut = (m_vOut - e)*g;
+
+    // Inductor: the switch node is either at Vin or one diode drop below ground.
+    // The diode does not allow the inductor current to go negative (DCM).
+    double vSwitchNode = switchOn ? p.m_vIn : -p.m_vDiode;
+    m_iL += (vSwitchNode - m_vOut - m_iL*p.m_rSwitch)*dt/p.m_inductance;
+    if (m_iL < 0)
+        m_iL = 0;
+
+    m_vCap += (m_vOut - m_vCap)/p.m_esr*dt/p.m_capacitance;
+
+    m_vAdc += (m_vOut - m_vAdc)*dt/p.m_adcFilterTau;
+    m_iAdc += (m_iOut - m_iAdc)*dt/p.m_adcFilterTau;
+
+    if (g && e)
+    {
+        m_vPolarization += (m_iOut - m_vPolarization/m_load.m_rPolarization)*dt/m_load.m_cPolarization;
+        m_chargeAh += m_iOut*dt/3600;
+    }
+}
+
+double CPlant::Noise()
+{
+    if (m_params.m_adcNoise <= 0)
+        return 0;
+
+    // Sum of four uniform values, roughly gaussian with the given RMS
+    double sum = 0;
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        m_random = m_random*1103515245 + 12345;
+        sum += static_cast<double>((m_random >> 8) & 0xFFFF)/65536.0 - 0.5;
+    }
+
+    return sum*sqrt(3.0)*m_params.m_adcNoise;
+}
+
+} // namespace sim
@@ -0,0 +1,113 @@
+// Discrete-time model of the charger output stage and its load.
+//
+// The output stage is an asynchronous buck converter switched by OC0A at 62.5 kHz
+// (timer 0 fast PWM at Fcpu/1), followed by the output relay and the load. The load is
+// either a resistor or a battery (open circuit voltage, internal resistance and one RC
+// polarization branch). The model is integrated with a fixed step of a few CPU clocks, so
+// the inductor current ripple, the discontinuous conduction mode and the ADC sampling point
+// inside the PWM period (behind the ADC input filters) are all taken into account.
+//
+// Component values below are estimates, not measured values. Tweak them to match your board.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace sim {
+
+struct SPlantParams
+{
+    // Input voltage, switch + inductor resistance and freewheeling diode drop
+    double m_vIn = 28.0;
+    double m_rSwitch = 0.05;
+    double m_vDiode = 0.45;
+
+    // Output inductor and capacitor (with its ESR)
+    double m_inductance = 47e-6;
+    double m_capacitance = 470e-6;
+    double m_esr = 0.1;
+
+    // Voltage divider bleed resistance (always connected to the capacitor)
+    double m_rBleed = 10e3;
+
+    // Current shunt, relay contacts and output wires resistance
+    double m_rWires = 0.1;
+
+    // ADC full scale (1023) values in volts and amperes, calculated from
+    // DEFAULT_VOLTAGE_COEFF and DEFAULT_CURRENT_COEFF
+    double m_adcVoltageScale = 24.621*1023/1024;
+    double m_adcCurrentScale = 12.300*1023/1024;
+
+    // Time constant of the RC filters at the ADC inputs. Without them the ADC would
+    // sample the inductor current ripple at a fixed point of the PWM period.
+    double m_adcFilterTau = 100e-6;
+
+    // RMS ADC noise in LSBs
+    double m_adcNoise = 0.0;
+};
+
+enum class ELoad : uint8_t
+{
+    Open = 0,
+    Resistor,
+    Battery,
+};
+
+struct SLoad
+{
+    ELoad m_type = ELoad::Open;
+
+    // Resistor load
+    double m_resistance = 10.0;
+
+    // Battery load: open circuit voltage at 0% charge and its slope,
+    // internal resistance and polarization branch
+    double m_ocv = 18.0;
+    double m_ocvPerAh = 0.8;
+    double m_rInternal = 0.08;
+    double m_rPolarization = 0.03;
+    double m_cPolarization = 1000.0;
+};
+
+class CPlant
+{
+public:
+    SPlantParams m_params;
+    SLoad m_load;
+
+    // State: inductor current, output capacitor voltage, battery
+    // polarization voltage and the charge delivered to the battery
+    double m_iL = 0;
+    double m_vCap = 0;
+    double m_vPolarization = 0;
+    double m_chargeAh = 0;
+
+    // Output voltage and output (load) current
+    double m_vOut = 0;
+    double m_iOut = 0;
+
+    // Output voltage and current averaged over the last PWM period
+    double m_vOutAverage = 0;
+    double m_iOutAverage = 0;
+
+    // Output voltage and current after the ADC input filters
+    double m_vAdc = 0;
+    double m_iAdc = 0;
+
+    void Reset();
+
+    // Simulates one PWM period (256 CPU clocks) and samples the ADC channel
+    // 'adcChannel' (0 - voltage, 1 - current) at CPU clock 'adcSampleClock'.
+    // The OC0A output is high for (ocr0a + 1) clocks if pwmEnabled is set.
+    // Returns the 10-bit ADC result.
+    uint16_t RunPwmPeriod(uint8_t ocr0a, bool pwmEnabled, bool relayOn,
+        uint8_t adcChannel, uint16_t adcSampleClock);
+
+private:
+    uint32_t m_random = 1;
+
+    void Step(bool switchOn, bool relayOn, double dt);
+    double Noise();
+};
+
+} // namespace sim
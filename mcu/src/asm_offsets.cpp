@@ -0,0 +1,37 @@
+// Struct sizes and member offsets used by the assembly code.
+//
+// gen_asm_offsets.py compiles this file to assembly with GENERATE_ASM_OFFSETS defined and
+// turns the "->NAME value" markers into asm_offsets.h (included by common.h for the
+// assembly files). In the normal build the file checks that asm_offsets.h is up to date.
+
+#include "includes.h"
+#include <stddef.h>
+
+#ifdef GENERATE_ASM_OFFSETS
+#define ASM_OFFSET(name, value) asm volatile ("\n->" #name " %0" :: "n" (value))
+#else
+#include "asm_offsets.h"
+#define ASM_OFFSET(name, value) static_assert(name == (value), "asm_offsets.h is out of date: " #name)
+#endif
+
+void AsmOffsets()
+{
+    // SSettings members read by the timer interrupt
+    ASM_OFFSET(OFFSET_SETTINGS_BEEP_LENGTH, offsetof(SSettings, m_keyBeepLength));
+    ASM_OFFSET(OFFSET_SETTINGS_VOLTAGE_OFFSET, offsetof(SSettings, m_voltageOffset));
+    ASM_OFFSET(OFFSET_SETTINGS_CURRENT_OFFSET, offsetof(SSettings, m_currentOffset));
+
+    // eeprom::SWrite, the EEPROM write queue entry
+    ASM_OFFSET(EEPROM_WRITE_SIZE, sizeof(eeprom::SWrite));
+    ASM_OFFSET(EEPROM_WRITE_DATA, offsetof(eeprom::SWrite, m_data));
+    ASM_OFFSET(EEPROM_WRITE_ADDRESS, offsetof(eeprom::SWrite, m_address));
+    ASM_OFFSET(EEPROM_WRITE_COUNT, offsetof(eeprom::SWrite, m_count));
+
+#ifdef DIAGNOSTICS
+    // SIsrPathStats, the ISR profiler statistics
+    ASM_OFFSET(DIAG_STATS_SIZE, sizeof(SIsrPathStats));
+    ASM_OFFSET(DIAG_STATS_MAX, offsetof(SIsrPathStats, m_max));
+    ASM_OFFSET(DIAG_STATS_COUNT, offsetof(SIsrPathStats, m_count));
+    ASM_OFFSET(DIAG_STATS_SUM, offsetof(SIsrPathStats, m_sum));
+#endif
+}
@@ -0,0 +1,148 @@
+#include "includes.h"
+
+namespace charge_log {
+
+static_assert(sizeof(SRecord) <= EEPROM_COPY_BUFFER_SIZE, "A record must fit the EEPROM write buffer");
+static_assert(EEPROM_ADDR_SESSIONS + EEPROM_SESSIONS_COUNT*sizeof(SRecord) <= E2END + 1,
+    "Session records don't fit the EEPROM");
+static_assert(EEPROM_PROFILES_COUNT <= 16, "A profile number must fit 4 bits");
+
+static SRecord* GetRecordEepromAddr(uint8_t slot)
+{
+    return reinterpret_cast<SRecord*>(EEPROM_ADDR_SESSIONS + slot*sizeof(SRecord));
+}
+
+static uint8_t ReadSequence(uint8_t slot)
+{
+    return eeprom_read_byte(&GetRecordEepromAddr(slot)->m_sequence);
+}
+
+static uint8_t NextSequence(uint8_t sequence)
+{
+    return sequence >= 254 ? 0 : sequence + 1;
+}
+
+static uint8_t GetChecksum(const SRecord& record)
+{
+    // Sum of all the bytes except the checksum (the last but one byte)
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(&record);
+    uint8_t sum = record.m_sequence;
+    for (uint8_t i = 0; i < sizeof(SRecord) - 2; ++i)
+        sum += data[i];
+
+    return ~sum;
+}
+
+uint8_t GetNameHash(const char* name, uint8_t length)
+{
+    // Rotate and xor, so swapped characters give a different hash too
+    uint8_t hash = length;
+    for (uint8_t i = 0; i < length; ++i)
+        hash = static_cast<uint8_t>((hash << 1) | (hash >> 7)) ^ name[i];
+
+    return hash;
+}
+
+void Init()
+{
+    eeprom::Wait();
+
+    // The newest record is the one not followed by the next sequence number
+    g_lastSlot = 0xFF;
+    for (uint8_t slot = 0; slot < EEPROM_SESSIONS_COUNT; ++slot)
+    {
+        uint8_t sequence = ReadSequence(slot);
+        if (sequence == 0xFF)
+            continue;
+
+        if (ReadSequence((slot + 1) % EEPROM_SESSIONS_COUNT) != NextSequence(sequence))
+        {
+            g_lastSlot = slot;
+            g_lastSequence = sequence;
+            break;
+        }
+    }
+}
+
+void StartSession()
+{
+    g_sessionActive = true;
+    g_maxBatteryTemp = g_maxBoardTemp = -0x8000;
+}
+
+void UpdateSession()
+{
+    int16_t temp = utils::ReadU16(g_temperatureBattery);
+    if (temp > g_maxBatteryTemp)
+        g_maxBatteryTemp = temp;
+
+    temp = utils::ReadU16(g_temperatureBoard);
+    if (temp > g_maxBoardTemp)
+        g_maxBoardTemp = temp;
+}
+
+void FinishSession(uint8_t result, uint16_t mOhmResistance)
+{
+    if (!g_sessionActive)
+        return;
+
+    g_sessionActive = false;
+
+    SRecord record;
+    record.m_profileNumber = g_settings.m_chargerProfileNumber;
+    record.m_result = result;
+    record.m_profileNameHash = GetNameHash(charger::g_profile.m_name, charger::g_profile.m_nameLength);
+    record.m_minutes = static_cast<uint16_t>(g_time[3])*60 + g_time[2];
+
+    // Same as in CapacityToString()
+    uint32_t capacity = utils::GetCurrentSumDiv4M();
+    if (capacity > 250000ul)
+        capacity = capacity/10*g_settings.m_current4096Value/27466*10;
+    else
+        capacity = capacity*g_settings.m_current4096Value/27466;
+    record.m_capacityX1000 = capacity > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(capacity);
+
+    uint32_t energy = utils::GetEnergyX100000()/1000;
+    record.m_energyX100 = energy > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(energy);
+
+    uint16_t voltage, current;
+    utils::GetAdcAverages(voltage, current);
+    record.m_voltageX1000 = g_settings.AdcVoltageToDisplayX1000(voltage);
+    record.m_resistance = mOhmResistance;
+
+    // TMP100 register values are degrees in the high byte
+    record.m_maxBatteryTemp = static_cast<int8_t>(g_maxBatteryTemp >> 8);
+    record.m_maxBoardTemp = static_cast<int8_t>(g_maxBoardTemp >> 8);
+
+    uint8_t slot = 0;
+    record.m_sequence = 0;
+    if (g_lastSlot != 0xFF)
+    {
+        slot = (g_lastSlot + 1) % EEPROM_SESSIONS_COUNT;
+        record.m_sequence = NextSequence(g_lastSequence);
+    }
+    record.m_checksum = GetChecksum(record);
+
+    eeprom::WriteCopy(reinterpret_cast<uint16_t>(GetRecordEepromAddr(slot)), &record, sizeof(SRecord));
+    g_lastSlot = slot;
+    g_lastSequence = record.m_sequence;
+}
+
+bool ReadRecord(uint8_t n, SRecord& record)
+{
+    if (g_lastSlot == 0xFF || n >= EEPROM_SESSIONS_COUNT)
+        return false;
+
+    uint8_t slot = (g_lastSlot + EEPROM_SESSIONS_COUNT - n) % EEPROM_SESSIONS_COUNT;
+    eeprom::Wait();
+    eeprom_read_block(&record, GetRecordEepromAddr(slot), sizeof(SRecord));
+
+    // Older records must have the preceding sequence numbers
+    uint8_t sequence = record.m_sequence;
+    for (uint8_t i = 0; i < n; ++i)
+        sequence = NextSequence(sequence);
+
+    return sequence == g_lastSequence && record.m_checksum == GetChecksum(record);
+}
+
+} // namespace charge_log
@@ -0,0 +1,78 @@
+#pragma once
+
+// Charge session log. A record is written when a charge session ends. Records are kept
+// in a ring buffer of EEPROM_SESSIONS_COUNT slots at EEPROM_ADDR_SESSIONS, every new
+// record goes to the next slot, so the EEPROM wear is spread evenly.
+
+#include "data.h"
+
+namespace charge_log {
+
+// Session results
+#define SESSION_COMPLETE 1
+#define SESSION_INTERRUPTED 2
+#define SESSION_BATTERY_ERROR 3
+#define SESSION_STOPPED 4
+
+struct SRecord
+{
+    // Charger profile number and the session result (SESSION_*). They share one byte, so
+    // the profile name hash fits the EEPROM (the records take all of it up to E2END).
+    uint8_t m_profileNumber : 4;
+    uint8_t m_result : 4;
+
+    // Profile name hash at the end of the session (see GetNameHash()). The profile can be
+    // renamed or replaced later, then the history shows the profile number instead of its name.
+    uint8_t m_profileNameHash;
+
+    // Charge time in minutes, delivered capacity in mAh and energy in 10 mWh units
+    uint16_t m_minutes;
+    uint16_t m_capacityX1000;
+    uint16_t m_energyX100;
+
+    // Battery voltage at the end of the session and its internal resistance in mOhm
+    // (0 - not measured)
+    uint16_t m_voltageX1000;
+    uint16_t m_resistance;
+
+    // Peak battery and board temperatures in degrees
+    int8_t m_maxBatteryTemp;
+    int8_t m_maxBoardTemp;
+
+    uint8_t m_checksum;
+
+    // Incremented with every record, 0 - 254 (0xFF is an empty slot). It's the last
+    // field, so it's written last.
+    uint8_t m_sequence;
+};
+
+// Finds the newest record in the EEPROM, must be called once at startup
+void Init();
+
+// Starts a new session
+void StartSession();
+
+// Tracks the peak temperatures, must be called periodically while charging
+void UpdateSession();
+
+// Finishes the session started by StartSession() and writes its record to the EEPROM
+// in the background. Does nothing if the session is already finished.
+void FinishSession(uint8_t result, uint16_t mOhmResistance);
+
+// Returns the hash of a profile name
+uint8_t GetNameHash(const char* name, uint8_t length);
+
+// Reads the n-th newest record (0 - the newest one). Returns false if there is no such record
+// or it's corrupted.
+bool ReadRecord(uint8_t n, SRecord& record);
+
+// The newest record slot (0xFF - no records) and its sequence number
+var uint8_t g_lastSlot;
+var uint8_t g_lastSequence;
+
+// Current session state and peak temperatures (TMP100 register values)
+var bool g_sessionActive;
+var int16_t g_maxBatteryTemp;
+var int16_t g_maxBoardTemp;
+
+} // namespace charge_log
@@ -21,6 +21,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 20500,
         .m_stopChargeCurrentPercent = 10,
         .m_options = COPT_MAKITA_PROTOCOL,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -36,6 +38,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 20500,
         .m_stopChargeCurrentPercent = 10,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -51,6 +55,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 4100,
         .m_stopChargeCurrentPercent = 5,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI/2,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -66,6 +72,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 8200,
         .m_stopChargeCurrentPercent = 5,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -81,6 +89,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 12300,
         .m_stopChargeCurrentPercent = 5,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -96,6 +106,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 16400,
         .m_stopChargeCurrentPercent = 5,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -111,6 +123,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 20500,
         .m_stopChargeCurrentPercent = 5,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -126,6 +140,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 8200,
         .m_stopChargeCurrentPercent = 5,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -141,6 +157,8 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 10000,
         .m_stopChargeCurrentPercent = 5,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 
@@ -156,18 +174,77 @@ static const SProfile pm_profiles[EEPROM_PROFILES_COUNT] PROGMEM =
         .m_restartChargeVoltageX1000 = 10000,
         .m_stopChargeCurrentPercent = 5,
         .m_options = 0,
+        .m_pidKp = DEFAULT_PID_KP,
+        .m_pidKi = DEFAULT_PID_KI,
         .m_magicNumber = SProfile::MagicNumber,
     },
 };
 
 //PrintSize<sizeof(pm_profiles)> printSize;
 
+static_assert(EEPROM_ADDR_PROFILES + EEPROM_PROFILES_COUNT*sizeof(SProfile) <= EEPROM_ADDR_SESSIONS,
+    "Charger profiles overlap the charge session records");
+
+// Profile field tags for the layout migration (see eeprom::MigrateFields())
+enum : uint8_t
+{
+    PF_NAME = 1,                // m_name, m_nameLength
+    PF_VOLTAGES_CURRENTS,       // m_chargeVoltageX1000 - m_restartChargeVoltageX1000
+    PF_STOP_CHARGE_CURRENT,
+    PF_OPTIONS,
+    PF_PID_GAINS,
+};
+
+// The current profile layout. When SProfile is changed, bump the magic number and convert
+// the old profiles in MigrateEeprom().
+static constexpr uint8_t pm_profileLayout[] PROGMEM =
+{
+    PF_NAME, 21, PF_VOLTAGES_CURRENTS, 12, PF_STOP_CHARGE_CURRENT, 1, PF_OPTIONS, 1,
+    PF_PID_GAINS, 2, LAYOUT_SKIP, 1, 0
+};
+
+static_assert(eeprom::GetLayoutSize(pm_profileLayout) == sizeof(SProfile), "Fix pm_profileLayout");
+
+// 0x18: no PID gains
+static constexpr uint8_t OldMagicNumber18 = 0x18;
+static constexpr uint8_t pm_profileLayout18[] PROGMEM =
+{
+    PF_NAME, 21, PF_VOLTAGES_CURRENTS, 12, PF_STOP_CHARGE_CURRENT, 1, PF_OPTIONS, 1,
+    LAYOUT_SKIP, 1, 0
+};
+
+void SProfile::MigrateEeprom()
+{
+    constexpr uint8_t oldSize = eeprom::GetLayoutSize(pm_profileLayout18);
+
+    // The old profiles are shorter, so a converted profile overlaps the next old one.
+    // Go downwards, so every old profile is converted before it's overwritten.
+    for (uint8_t nProfile = EEPROM_PROFILES_COUNT; nProfile-- > 0;)
+    {
+        eeprom::Wait();
+        if (eeprom_read_byte(&GetProfileEepromAddr(nProfile)->m_magicNumber) == MagicNumber)
+            continue;
+
+        uint16_t oldAddress = EEPROM_ADDR_PROFILES + nProfile*oldSize;
+        if (eeprom_read_byte(reinterpret_cast<const uint8_t*>(oldAddress + oldSize - 1)) != OldMagicNumber18)
+            continue;
+
+        // The missing fields are taken from the default profile
+        memcpy_P(&g_tempProfile, &pm_profiles[nProfile], sizeof(SProfile));
+        eeprom::MigrateFields(oldAddress, pm_profileLayout18, &g_tempProfile, pm_profileLayout);
+        g_tempProfile.SaveToEeprom(nProfile);
+    }
+
+    eeprom::Wait();
+}
+
 void SProfile::LoadFromEeprom(uint8_t nProfile)
 {
     if (nProfile >= EEPROM_PROFILES_COUNT)
         nProfile = 0;
 
     // Check whether we have a valid profile in EEPROM
+    eeprom::Wait();
     SProfile* eepromProfile = GetProfileEepromAddr(nProfile);
     if (eeprom_read_byte(&eepromProfile->m_magicNumber) == MagicNumber)
         eeprom_read_block(this, eepromProfile, sizeof(SProfile));
@@ -180,7 +257,14 @@ void SProfile::SaveToEeprom(uint8_t nProfile)
     if (nProfile >= EEPROM_PROFILES_COUNT)
         nProfile = 0;
 
-    eeprom_update_block(this, GetProfileEepromAddr(nProfile), sizeof(SProfile));
+    static_assert(sizeof(SProfile) <= EEPROM_COPY_BUFFER_SIZE, "Profiles don't fit the EEPROM copy buffer");
+    eeprom::WriteCopy(reinterpret_cast<uint16_t>(GetProfileEepromAddr(nProfile)), this, sizeof(SProfile));
+}
+
+void SProfile::SetPidGains() const
+{
+    g_pidKp = m_pidKp;
+    g_pidKi = m_pidKi;
 }
 
 SProfile* SProfile::GetProfileEepromAddr(uint8_t nProfile)
@@ -47,15 +47,29 @@ struct SProfile
     // Charge options flags (defined above)
     uint8_t m_options;
 
+    // PID proportional and integral gains (see g_pidKp and g_pidKi)
+    uint8_t m_pidKp;
+    uint8_t m_pidKi;
+
     // Pure random number, chosen by a fair dice roll
-    static constexpr uint8_t MagicNumber = 0x18;
+    static constexpr uint8_t MagicNumber = 0x19;
     uint8_t m_magicNumber;
 
     // Loads profile from the EEPROM. If profile was not stored there yet, loads it
     // from the program memory
     void LoadFromEeprom(uint8_t nProfile);
+
+    // Queues a copy of the profile to be written (see eeprom::WriteCopy()), so the profile
+    // can be changed right away
     void SaveToEeprom(uint8_t nProfile);
 
+    // Converts the profiles stored with an older layout, must be called once at startup
+    // (before the profiles are loaded). Uses g_tempProfile.
+    static void MigrateEeprom();
+
+    // Loads the profile PID gains to g_pidKp and g_pidKi
+    void SetPidGains() const;
+
 private:
     static SProfile* GetProfileEepromAddr(uint8_t nProfile);
 };
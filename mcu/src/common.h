@@ -40,9 +40,82 @@
 #define ADC_SRA_VALUE (BV(ADEN) | BV(ADSC) | BV(ADPS2))
 #define ADC_SHORT_CIRCUIT_VALUE 0x03E0
 
+// Uncomment to run the PID every 4th timer interrupt (on two voltage and two current
+// samples) instead of every 8th one. The averager, encoder and 100 Hz timer still run
+// every 8th interrupt. Can also be defined in build_flags.
+//#define PID_FAST_LOOP
+
+// ADC filter chain. Every PID cycle the voltage and current samples (on the PID target
+// scale) go to:
+// - the fast channel, a first-order IIR filter with the 1/2^ADC_FAST_FILTER_SHIFT
+//   coefficient (time constant of 2^ADC_FAST_FILTER_SHIFT PID cycles). It's used by the
+//   overvoltage and overcurrent protection. The shift must be in [1, 4].
+// - the 256-cycle averager (30.5 updates per second). Its sum gives both the averages and
+//   the high resolution values (16 times the average scale), the latter are smoothed by
+//   a first-order IIR filter with the 1/2^ADC_DISPLAY_FILTER_SHIFT coefficient for the
+//   display (0 - no filter). The shift must be in [0, 4].
+// Both can also be defined in build_flags.
+#ifndef ADC_FAST_FILTER_SHIFT
+#define ADC_FAST_FILTER_SHIFT 3
+#endif
+#ifndef ADC_DISPLAY_FILTER_SHIFT
+#define ADC_DISPLAY_FILTER_SHIFT 2
+#endif
+
+#if ADC_FAST_FILTER_SHIFT < 1 || ADC_FAST_FILTER_SHIFT > 4
+#error ADC_FAST_FILTER_SHIFT must be in [1, 4]
+#endif
+#if ADC_DISPLAY_FILTER_SHIFT < 0 || ADC_DISPLAY_FILTER_SHIFT > 4
+#error ADC_DISPLAY_FILTER_SHIFT must be in [0, 4]
+#endif
+
+// I^2*t overcurrent protection, run by the timer interrupt every PID cycle on the current
+// sample (PID target scale). While the current I is above OVERCURRENT_I2T_START, the
+// accumulator grows by about (I^2 - OVERCURRENT_I2T_START^2)/256 per cycle, otherwise it
+// drops by OVERCURRENT_I2T_COOLING. The output is switched off with the overcurrent
+// failure when it reaches OVERCURRENT_I2T_TRIP. So the trip time is about
+// OVERCURRENT_I2T_TRIP*256/(I^2 - OVERCURRENT_I2T_START^2) PID cycles of 128 us. With the
+// defaults (9 A), that's 10 ms at 10 A and 4 ms at 11 A (the short circuit protection acts
+// above 11.9 A). PID_FAST_LOOP runs the protection twice as often, so the trip level is
+// doubled and the cooling is halved for it (OVERCURRENT_I2T_CYCLE_*), which keeps the times.
+// Can also be defined in build_flags.
+#ifndef OVERCURRENT_I2T_START
+#define OVERCURRENT_I2T_START 3072
+#endif
+#ifndef OVERCURRENT_I2T_TRIP
+#define OVERCURRENT_I2T_TRIP 0x080000
+#endif
+#ifndef OVERCURRENT_I2T_COOLING
+#define OVERCURRENT_I2T_COOLING 2048
+#endif
+
+#if OVERCURRENT_I2T_START < 2048 || OVERCURRENT_I2T_START > 4092
+#error OVERCURRENT_I2T_START must be in [2048, 4092]
+#endif
+#ifdef PID_FAST_LOOP
+#define OVERCURRENT_I2T_CYCLE_TRIP (OVERCURRENT_I2T_TRIP*2)
+#define OVERCURRENT_I2T_CYCLE_COOLING (OVERCURRENT_I2T_COOLING/2)
+#else
+#define OVERCURRENT_I2T_CYCLE_TRIP OVERCURRENT_I2T_TRIP
+#define OVERCURRENT_I2T_CYCLE_COOLING OVERCURRENT_I2T_COOLING
+#endif
+
+#if OVERCURRENT_I2T_CYCLE_TRIP > 0xFF0000
+#error OVERCURRENT_I2T_TRIP must not exceed 0xFF0000 (0x7F8000 with PID_FAST_LOOP)
+#endif
+
 #define PID_MODE_OFF 0x00
 #define PID_MODE_CV 0x01
 #define PID_MODE_CC 0x02
+// The PID doesn't run, g_pwmValue and GPIOR0_ADC_EARLY_START are set by the ADC timing
+// calibration (see screen_calibration.cpp)
+#define PID_MODE_MANUAL 0x03
+
+// GPIOR0 bits (accessible by sbi/cbi/sbic/sbis).
+// Set if the timer interrupt must use the early ADC start section for the current PWM value
+#define GPIOR0_ADC_EARLY_START 0
+// Set by the timer interrupt when the averager sums are ready to be rolled over
+#define GPIOR0_AVERAGER_READY 1
 
 // Display constants
 #define DISPLAY_WIDTH 240
@@ -59,12 +132,34 @@
 
 #define DISPLAY_DOES_NOT_FIT 255
 
-// Quite a nasty part: avrgcc assembler cannot access C struct members since
-// it does not know a member offset. So we explicitly define needed offsets here.
-// And yes, if a struct definition is changed, you may need to manually fix the offsets.
-#define OFFSET_SETTINGS_BEEP_LENGTH 0
-#define OFFSET_SETTINGS_VOLTAGE_OFFSET 2
-#define OFFSET_SETTINGS_CURRENT_OFFSET 5
+// Widget cache size and the longest cached widget text (see display.h)
+#define DISPLAY_WIDGET_COUNT 15
+#define DISPLAY_WIDGET_TEXT_SIZE 8
+
+// The assembler cannot access C struct members since it doesn't know their offsets.
+// The struct sizes and member offsets used by the assembly code (OFFSET_SETTINGS_*,
+// DIAG_STATS_*, EEPROM_WRITE_*) are generated from asm_offsets.cpp before every build
+// (see gen_asm_offsets.py).
+#ifdef __ASSEMBLER__
+#include "asm_offsets.h"
+#endif
+
+// *** Diagnostics ***
+
+// Timer0 interrupt paths measured by the ISR profiler (DIAGNOSTICS builds only).
+// Every path is measured in CPU clocks from the timer overflow to the path end.
+// Only one path is recorded per interrupt, the ADC start time (TCNT0 right after
+// the conversion start) is tracked as a maximum only, see g_diagAdcStartMax.
+// ADC paths: the normal and early start ADC sections of every interrupt
+#define DIAG_PATH_ADC_NORMAL 0
+#define DIAG_PATH_ADC_EARLY 1
+// The eighth interrupt: PID and encoder (and the PID of the fourth one with PID_FAST_LOOP)
+#define DIAG_PATH_8TH 2
+// The eighth interrupt with the ADC averager roll-over
+#define DIAG_PATH_AVERAGER 3
+// The eighth interrupt with the Timer100Hz() call
+#define DIAG_PATH_100HZ 4
+#define DIAG_PATH_COUNT 5
 
 // *** TWI ***
 
@@ -90,3 +185,8 @@
 // Any other error
 #define TWI_STATE_UNKNOWN_ERROR 0x05
 
+
+// *** EEPROM ***
+
+// Number of the background EEPROM write queue entries (one is always left free)
+#define EEPROM_QUEUE_SIZE 4
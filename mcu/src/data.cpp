@@ -4,8 +4,99 @@
 // Include the main include file to instantiate all defined variables
 #include "includes.h"
 
+bool SCalibrationTable::AddPoint(uint16_t hiResAdc, uint16_t x1000)
+{
+    SCalibrationTable oldTable = *this;
+
+    // Replace a point closer than 16 ADC units or insert the new one keeping the order
+    uint8_t i = 0;
+    while (i < m_count && m_points[i].m_hiResAdc + 256 <= hiResAdc)
+        ++i;
+
+    if (i == m_count || m_points[i].m_hiResAdc >= hiResAdc + 256)
+    {
+        if (m_count == CALIBRATION_POINTS)
+            return false;
+
+        for (uint8_t j = m_count; j > i; --j)
+            m_points[j] = m_points[j - 1];
+        ++m_count;
+    }
+
+    m_points[i].m_hiResAdc = hiResAdc;
+    m_points[i].m_x1000 = x1000;
+
+    if (UpdateSlopes())
+        return true;
+
+    *this = oldTable;
+    return false;
+}
+
+void SCalibrationTable::Rebuild()
+{
+    if (m_count > CALIBRATION_POINTS || !UpdateSlopes())
+        m_count = 0;
+}
+
+bool SCalibrationTable::UpdateSlopes()
+{
+    for (uint8_t i = 0; i + 1 < m_count; ++i)
+    {
+        uint16_t adcDelta = m_points[i + 1].m_hiResAdc - m_points[i].m_hiResAdc;
+        if (m_points[i + 1].m_x1000 <= m_points[i].m_x1000)
+            return false;
+
+        uint32_t slope = ((static_cast<uint32_t>(m_points[i + 1].m_x1000 - m_points[i].m_x1000) << 16) +
+            (adcDelta >> 1))/adcDelta;
+        if (slope <= 0x0100 || slope >= 0x8000)
+            return false;
+
+        m_slopes[i] = static_cast<uint16_t>(slope);
+        m_invSlopes[i] = 0xFFFFFFFF/slope;
+    }
+
+    return true;
+}
+
+uint16_t SCalibrationTable::HiResToX1000(uint16_t hiResAdc) const
+{
+    uint8_t i = 0;
+    while (i + 2 < m_count && hiResAdc >= m_points[i + 1].m_hiResAdc)
+        ++i;
+
+    int32_t x1000 = m_points[i].m_x1000 +
+        (((static_cast<int32_t>(hiResAdc) - m_points[i].m_hiResAdc)*m_slopes[i] + 32768) >> 16);
+    if (x1000 < 0)
+        return 0;
+
+    return x1000 > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(x1000);
+}
+
+uint16_t SCalibrationTable::X1000ToHiRes(uint16_t x1000) const
+{
+    uint8_t i = 0;
+    while (i + 2 < m_count && x1000 >= m_points[i + 1].m_x1000)
+        ++i;
+
+    // HiRes = delta*m_invSlopes/65536, the integer part of the reciprocal is less than 256
+    int32_t delta = static_cast<int32_t>(x1000) - m_points[i].m_x1000;
+    uint16_t absDelta = static_cast<uint16_t>(delta < 0 ? -delta : delta);
+    uint32_t invSlope = m_invSlopes[i];
+    int32_t step = static_cast<int32_t>(static_cast<uint32_t>(absDelta)*static_cast<uint16_t>(invSlope >> 16) +
+        ((static_cast<uint32_t>(absDelta)*static_cast<uint16_t>(invSlope) + 32768) >> 16));
+    int32_t hiResAdc = m_points[i].m_hiResAdc + (delta < 0 ? -step : step);
+    if (hiResAdc < 0)
+        return 0;
+
+    return hiResAdc > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(hiResAdc);
+}
+
 uint16_t SSettings::AdcVoltageToDisplayX1000(uint16_t adcVoltage)
 {
+    if (m_voltageTable.IsUsed())
+        return m_voltageTable.HiResToX1000(adcVoltage << 4);
+
     // Vx1000 = (ADCv + m_voltageOffset)*m_voltage4096Value/4096
     int16_t voltage = static_cast<int16_t>(adcVoltage) + static_cast<int16_t>(m_voltageOffset);
     if (voltage < 0)
@@ -16,6 +107,9 @@ uint16_t SSettings::AdcVoltageToDisplayX1000(uint16_t adcVoltage)
 
 uint16_t SSettings::AdcCurrentToDisplayX1000(uint16_t adcCurrent)
 {
+    if (m_currentTable.IsUsed())
+        return m_currentTable.HiResToX1000(adcCurrent << 4);
+
     // Cx1000 = (ADCc + m_currentOffset)*m_current4096Value/4096
     int16_t current = static_cast<int16_t>(adcCurrent) + static_cast<int16_t>(m_currentOffset);
     if (current < 0)
@@ -24,9 +118,50 @@ uint16_t SSettings::AdcCurrentToDisplayX1000(uint16_t adcCurrent)
     return utils::ShiftRight12(static_cast<uint32_t>(current)*m_current4096Value + 2048);
 }
 
+uint16_t SSettings::HiResVoltageToDisplayX1000(uint16_t hiResVoltage)
+{
+    if (m_voltageTable.IsUsed())
+        return m_voltageTable.HiResToX1000(hiResVoltage);
+
+    return LinearHiResVoltageToDisplayX1000(hiResVoltage);
+}
+
+uint16_t SSettings::HiResCurrentToDisplayX1000(uint16_t hiResCurrent)
+{
+    if (m_currentTable.IsUsed())
+        return m_currentTable.HiResToX1000(hiResCurrent);
+
+    return LinearHiResCurrentToDisplayX1000(hiResCurrent);
+}
+
+uint16_t SSettings::LinearHiResVoltageToDisplayX1000(uint16_t hiResVoltage)
+{
+    // Vx1000 = (ADCv*16 + m_voltageOffset*16)*m_voltage4096Value/65536
+    int32_t voltage = static_cast<int32_t>(hiResVoltage) + (static_cast<int16_t>(m_voltageOffset) << 4);
+    if (voltage < 0)
+        voltage = 0;
+
+    return static_cast<uint16_t>((static_cast<uint32_t>(voltage)*m_voltage4096Value + 32768) >> 16);
+}
+
+uint16_t SSettings::LinearHiResCurrentToDisplayX1000(uint16_t hiResCurrent)
+{
+    // Cx1000 = (ADCc*16 + m_currentOffset*16)*m_current4096Value/65536
+    int32_t current = static_cast<int32_t>(hiResCurrent) + (static_cast<int16_t>(m_currentOffset) << 4);
+    if (current < 0)
+        current = 0;
+
+    return static_cast<uint16_t>((static_cast<uint32_t>(current)*m_current4096Value + 32768) >> 16);
+}
+
 uint16_t SSettings::DisplayX1000VoltageToAdc(uint16_t x1000Voltage)
 {
-    int16_t voltage = static_cast<int16_t>((utils::ShiftLeft12(x1000Voltage) + 12000)/m_voltage4096Value) -
+    if (m_voltageTable.IsUsed())
+        return (m_voltageTable.X1000ToHiRes(x1000Voltage) + 8) >> 4;
+
+    // ADCv = Vx1000*4096/m_voltage4096Value - m_voltageOffset
+    int16_t voltage = static_cast<int16_t>(
+        (static_cast<uint32_t>(x1000Voltage)*g_voltageX1000ToAdcCoeff + g_voltageX1000ToAdcRound) >> 16) -
         static_cast<int16_t>(m_voltageOffset);
     if (voltage < 0)
         voltage = 0;
@@ -36,7 +171,12 @@ uint16_t SSettings::DisplayX1000VoltageToAdc(uint16_t x1000Voltage)
 
 uint16_t SSettings::DisplayX1000CurrentToAdc(uint16_t x1000Current)
 {
-    int16_t current = static_cast<int16_t>((utils::ShiftLeft12(x1000Current) + 6000)/m_current4096Value) -
+    if (m_currentTable.IsUsed())
+        return (m_currentTable.X1000ToHiRes(x1000Current) + 8) >> 4;
+
+    // ADCc = Cx1000*4096/m_current4096Value - m_currentOffset
+    int16_t current = static_cast<int16_t>(
+        (static_cast<uint32_t>(x1000Current)*g_currentX1000ToAdcCoeff + g_currentX1000ToAdcRound) >> 16) -
         static_cast<int16_t>(m_currentOffset);
     if (current < 0)
         current = 0;
@@ -44,28 +184,235 @@ uint16_t SSettings::DisplayX1000CurrentToAdc(uint16_t x1000Current)
     return static_cast<uint16_t>(current);
 }
 
-SSettings* SSettings::GetEepromSettingsAddr()
+uint16_t SSettings::AdcVoltageToFeedForwardPwm(uint16_t adcVoltage)
+{
+    uint32_t pwm = (static_cast<uint32_t>(adcVoltage)*m_pwmPerAdcVoltage) >> 8;
+    return pwm > 0xFF00 ? 0xFF00 : static_cast<uint16_t>(pwm);
+}
+
+static_assert(sizeof(SSettings) + sizeof(SSettingsHeader) <= EEPROM_SETTINGS_SLOT_SIZE,
+    "Settings don't fit an EEPROM slot");
+static_assert(EEPROM_ADDR_SETTINGS + EEPROM_SETTINGS_SLOTS*EEPROM_SETTINGS_SLOT_SIZE <= EEPROM_ADDR_PROFILES,
+    "Settings slots overlap the charger profiles");
+
+// Settings field tags for the layout migration (see eeprom::MigrateFields())
+enum : uint8_t
+{
+    SF_BEEP = 1,                // m_keyBeepLength, m_keyBeepVolume
+    SF_VOLTAGE_CALIBRATION,     // m_voltageOffset, m_voltage4096Value
+    SF_CURRENT_CALIBRATION,     // m_currentOffset, m_current4096Value
+    SF_MUSIC,                   // m_musicVolume - m_batteryErrorMusic
+    SF_PROFILE_NUMBER,
+    SF_PS_SETTINGS,
+    SF_FAN,                     // m_fanPwmMin - m_fanPowStop
+    SF_PS_PROFILES,
+    SF_PWM_PER_ADC_VOLTAGE,
+    SF_ADC_EARLY_START_MAP,
+    SF_VOLTAGE_TABLE,           // m_count and m_points (the slopes are recalculated)
+    SF_CURRENT_TABLE,
+};
+
+#define SF_COMMON_FIELDS \
+    SF_BEEP, 2, SF_VOLTAGE_CALIBRATION, 3, SF_CURRENT_CALIBRATION, 3, SF_MUSIC, 6, \
+    SF_PROFILE_NUMBER, 1, SF_PS_SETTINGS, 4, SF_FAN, 8, SF_PS_PROFILES, 40
+
+// The current settings layout. When SSettings is changed, bump the magic number and add
+// the old layout to pm_settingsVersions.
+static constexpr uint8_t pm_settingsLayout[] PROGMEM =
+{
+    SF_COMMON_FIELDS, SF_PWM_PER_ADC_VOLTAGE, 2, SF_ADC_EARLY_START_MAP, 4,
+    SF_VOLTAGE_TABLE, 25, LAYOUT_SKIP, 10, LAYOUT_SKIP, 20,
+    SF_CURRENT_TABLE, 25, LAYOUT_SKIP, 10, LAYOUT_SKIP, 20,
+    LAYOUT_SKIP, 2, 0
+};
+
+static_assert(eeprom::GetLayoutSize(pm_settingsLayout) == sizeof(SSettings), "Fix pm_settingsLayout");
+
+// 0x1236: the last layout released before the journal, no feed-forward PWM ratio, early ADC
+// start map and calibration tables
+static constexpr uint8_t pm_settingsLayout1236[] PROGMEM =
+{
+    SF_COMMON_FIELDS, LAYOUT_SKIP, 2, 0
+};
+
+// Known settings layouts, identified by the magic number (the last field of every layout)
+struct SSettingsVersion
+{
+    uint16_t m_magicNumber;
+    uint8_t m_size;
+    const uint8_t* m_layout;
+};
+
+static const SSettingsVersion pm_settingsVersions[] PROGMEM =
+{
+    {SSettings::MagicNumber, sizeof(SSettings), pm_settingsLayout},
+    {0x1236, eeprom::GetLayoutSize(pm_settingsLayout1236), pm_settingsLayout1236},
+};
+
+constexpr uint8_t SETTINGS_VERSION_COUNT = sizeof(pm_settingsVersions)/sizeof(pm_settingsVersions[0]);
+
+SSettings* SSettings::GetEepromSettingsAddr(uint8_t slot)
+{
+    return reinterpret_cast<SSettings*>(EEPROM_ADDR_SETTINGS + slot*EEPROM_SETTINGS_SLOT_SIZE);
+}
+
+SSettingsHeader* SSettings::GetEepromHeaderAddr(uint8_t slot)
+{
+    // At the slot end, so it doesn't move when the settings size changes
+    return reinterpret_cast<SSettingsHeader*>(EEPROM_ADDR_SETTINGS + (slot + 1)*EEPROM_SETTINGS_SLOT_SIZE -
+        sizeof(SSettingsHeader));
+}
+
+uint8_t SSettings::FindEepromVersion(uint8_t slot)
+{
+    const uint8_t* eepromAddr = reinterpret_cast<const uint8_t*>(GetEepromSettingsAddr(slot));
+    for (uint8_t version = 0; version < SETTINGS_VERSION_COUNT; ++version)
+    {
+        uint8_t size = pgm_read_byte(&pm_settingsVersions[version].m_size);
+        if (eeprom_read_word(reinterpret_cast<const uint16_t*>(eepromAddr + size - 2)) ==
+            pgm_read_word(&pm_settingsVersions[version].m_magicNumber))
+        {
+            return version;
+        }
+    }
+
+    return 0xFF;
+}
+
+uint16_t SSettings::GetEepromCrc(uint8_t slot, uint8_t sequence, uint8_t size)
 {
-    return reinterpret_cast<SSettings*>(EEPROM_ADDR_SETTINGS);
+    const uint8_t* eepromAddr = reinterpret_cast<const uint8_t*>(GetEepromSettingsAddr(slot));
+    uint16_t crc = _crc16_update(0xFFFF, sequence);
+    for (uint8_t i = 0; i < size; ++i)
+        crc = _crc16_update(crc, eeprom_read_byte(eepromAddr++));
+
+    return crc;
 }
 
-bool SSettings::AreEepromSettingsValid()
+uint16_t SSettings::GetCrc(uint8_t sequence) const
 {
-    return eeprom_read_word(&GetEepromSettingsAddr()->m_magicNumber) == SSettings::MagicNumber;
+    const uint8_t* dataAddr = reinterpret_cast<const uint8_t*>(this);
+    uint16_t crc = _crc16_update(0xFFFF, sequence);
+    for (uint8_t i = 0; i < sizeof(SSettings); ++i)
+        crc = _crc16_update(crc, *dataAddr++);
+
+    return crc;
 }
 
 bool SSettings::ReadFromEeprom()
 {
-    if (!AreEepromSettingsValid())
-        return false;
+    eeprom::Wait();
+    g_settingsWriteSlot = 0xFF;
 
-    eeprom_read_block(this, GetEepromSettingsAddr(), sizeof(SSettings));
+    // Check the slots in the EEPROM, so the settings are not changed if there is no valid one
+    uint8_t newest = 0xFF;
+    uint8_t newestVersion = 0;
+    for (uint8_t slot = 0; slot < EEPROM_SETTINGS_SLOTS; ++slot)
+    {
+        SSettingsHeader& header = g_settingsHeaders[slot];
+        eeprom_read_block(&header, GetEepromHeaderAddr(slot), sizeof(SSettingsHeader));
+        uint8_t version = FindEepromVersion(slot);
+        if (version == 0xFF ||
+            GetEepromCrc(slot, header.m_sequence, pgm_read_byte(&pm_settingsVersions[version].m_size)) != header.m_crc)
+        {
+            continue;
+        }
+
+        if (newest == 0xFF ||
+            static_cast<int8_t>(header.m_sequence - g_settingsHeaders[newest].m_sequence) > 0)
+        {
+            newest = slot;
+            newestVersion = version;
+        }
+    }
+
+    if (newest == 0xFF)
+    {
+        // The settings saved before they were journaled are a single 0x1236 block at the
+        // first slot address without a header. The current layout is valid only in a slot
+        // with the matching CRC.
+        newest = 0;
+        newestVersion = FindEepromVersion(0);
+        if (newestVersion == 0xFF || newestVersion == 0)
+            return false;
+    }
+
+    g_settingsSlot = newest;
+    if (newestVersion == 0)
+    {
+        eeprom_read_block(this, GetEepromSettingsAddr(newest), sizeof(SSettings));
+    }
+    else
+    {
+        // An older layout: carry its fields over to the defaults and save the result,
+        // so this is done only once
+        ResetToDefault();
+        eeprom::MigrateFields(reinterpret_cast<uint16_t>(GetEepromSettingsAddr(newest)),
+            reinterpret_cast<const uint8_t*>(pgm_read_word(&pm_settingsVersions[newestVersion].m_layout)),
+            this, pm_settingsLayout);
+        m_voltageTable.Rebuild();
+        m_currentTable.Rebuild();
+
+        // Make sure the settings are saved even if they happen to have the old CRC
+        SSettingsHeader& header = g_settingsHeaders[newest];
+        header.m_crc = ~GetCrc(header.m_sequence);
+        SaveToEeprom();
+    }
+
+    ApplyAdcEarlyStartMap();
+    UpdateConversionCoeffs();
     return true;
 }
 
+void SSettings::ApplyAdcEarlyStartMap()
+{
+    cli();
+    g_adcEarlyStartMap = m_adcEarlyStartMap & ~static_cast<uint32_t>(1);
+    sei();
+}
+
+void SSettings::UpdateConversionCoeffs()
+{
+    // The multipliers are at least 8000, so the coefficients fit 16 bits. The rounding terms
+    // are the ones of the former division: (x*4096 + 12000)/m_voltage4096Value and
+    // (x*4096 + 6000)/m_current4096Value.
+    g_voltageX1000ToAdcCoeff = static_cast<uint16_t>((static_cast<uint32_t>(1) << 28)/m_voltage4096Value);
+    g_voltageX1000ToAdcRound = static_cast<uint16_t>((static_cast<uint32_t>(12000) << 16)/m_voltage4096Value);
+    g_currentX1000ToAdcCoeff = static_cast<uint16_t>((static_cast<uint32_t>(1) << 28)/m_current4096Value);
+    g_currentX1000ToAdcRound = static_cast<uint16_t>((static_cast<uint32_t>(6000) << 16)/m_current4096Value);
+}
+
 void SSettings::SaveToEeprom()
 {
-    eeprom_update_block(this, GetEepromSettingsAddr(), sizeof(SSettings));
+    static_assert(EEPROM_SETTINGS_SLOTS == 2, "The slots are alternated");
+
+    if (!AreSettingsChanged())
+        return;
+
+    // The copy and the header of the previous save are read until they're written
+    eeprom::Wait();
+    FinishEepromWrite();
+
+    // Only the bytes that differ from the settings saved two times ago are written. The
+    // settings are written from a copy, so they can be changed right away and the CRC
+    // always matches the written bytes.
+    uint8_t slot = g_settingsSlot ^ 1;
+    SSettingsHeader& header = g_settingsHeaders[slot];
+    g_settingsCopy = *this;
+    header.m_sequence = g_settingsHeaders[g_settingsSlot].m_sequence + 1;
+    header.m_crc = g_settingsCopy.GetCrc(header.m_sequence);
+    eeprom::Write(reinterpret_cast<uint16_t>(GetEepromSettingsAddr(slot)), &g_settingsCopy, sizeof(SSettings));
+    eeprom::Write(reinterpret_cast<uint16_t>(GetEepromHeaderAddr(slot)), &header, sizeof(SSettingsHeader));
+    g_settingsWriteSlot = slot;
+}
+
+void SSettings::FinishEepromWrite()
+{
+    if (g_settingsWriteSlot != 0xFF && !eeprom::IsBusy())
+    {
+        g_settingsSlot = g_settingsWriteSlot;
+        g_settingsWriteSlot = 0xFF;
+    }
 }
 
 void SSettings::ResetToDefault()
@@ -113,21 +460,27 @@ void SSettings::ResetToDefault()
             { 4200,  300},
             { 8400,  300},
         },
+        .m_pwmPerAdcVoltage = 0,
+
+        // Early ADC start for the PWM high byte >= 64, see timer_int.S
+        .m_adcEarlyStartMap = 0xFFFFFF00,
+
         .m_magicNumber = MagicNumber,
     };
 
     memcpy_P(this, &pm_defaultSettings, sizeof(SSettings));
+    ApplyAdcEarlyStartMap();
+    UpdateConversionCoeffs();
 }
 
 bool SSettings::AreSettingsChanged()
 {
-    uint8_t* eepromAddr = reinterpret_cast<uint8_t*>(GetEepromSettingsAddr());
-    uint8_t* dataAddr = reinterpret_cast<uint8_t*>(this);
-    for (uint8_t i = 0; i < sizeof(SSettings); ++i, ++eepromAddr, ++dataAddr)
-        if (*dataAddr != eeprom_read_byte(eepromAddr))
-            return true;
+    static_assert(sizeof(SSettings) < 256, "Settings CRC is calculated with an 8-bit index");
 
-    return false;
+    // Compare with the settings being written, if any
+    FinishEepromWrite();
+    const SSettingsHeader& header = g_settingsHeaders[g_settingsWriteSlot != 0xFF ? g_settingsWriteSlot : g_settingsSlot];
+    return GetCrc(header.m_sequence) != header.m_crc;
 }
 
 void SSettings::SetFanSpeed()
@@ -161,9 +514,7 @@ void SSettings::SetFanSpeed()
     // Choke cooling
     const auto GetCurrentPwm = [&]() -> uint8_t
     {
-        cli();
         uint16_t current = g_adcCurrentAverage;
-        sei();
 
         if (current < 4500/3)
             return 0;
@@ -177,10 +528,8 @@ void SSettings::SetFanSpeed()
     // Power supply cooling
     const auto GetWattagePwm = [&]() -> uint8_t
     {
-        cli();
         uint8_t voltage = g_adcVoltageAverage >> 8;
         uint8_t current = g_adcCurrentAverage >> 8;
-        sei();
 
         // Wattage unit = ~1.18W, wattage range is [0..225]
         uint8_t wattage = voltage*current;
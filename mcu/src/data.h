@@ -6,8 +6,12 @@
 #endif
 
 #define EEPROM_ADDR_SETTINGS 0x0000
+#define EEPROM_SETTINGS_SLOT_SIZE 0x0100
+#define EEPROM_SETTINGS_SLOTS 2
 #define EEPROM_ADDR_PROFILES 0x0200
 #define EEPROM_PROFILES_COUNT 10
+#define EEPROM_ADDR_SESSIONS 0x0380
+#define EEPROM_SESSIONS_COUNT 8
 
 #include <stdint.h>
 
@@ -34,13 +38,33 @@ var uint16_t g_adcCurrentAcc;
 // The integral part of the PID algorithm
 var uint8_t g_pidIntegral[3];
 
-// Current PID mode, PID_MODE_OFF, PID_MODE_CV or PID_MODE_CC
+// Current PID mode, PID_MODE_OFF, PID_MODE_CV, PID_MODE_CC or PID_MODE_MANUAL
 var uint8_t g_pidMode;
 
 // Target ADC voltage and current for PID
 var uint16_t g_pidTargetVoltage;
 var uint16_t g_pidTargetCurrent;
 
+// PID proportional and integral gains, 1.7 fixed point values:
+// g_pidIntegral += diff*g_pidKi/128, PWM = diff*g_pidKp/128 + g_pidIntegral/2.
+// PID_FAST_LOOP adds diff*g_pidKi/256, so the gains mean the same in both builds.
+var uint8_t g_pidKp;
+var uint8_t g_pidKi;
+
+// Early ADC start map, a copy of SSettings::m_adcEarlyStartMap used by the timer interrupt
+var uint32_t g_adcEarlyStartMap;
+
+// Display to ADC conversion coefficients for the offset and multiplier calibration, set by
+// SSettings::UpdateConversionCoeffs(): 65536*4096/m_*4096Value and the rounding terms
+var uint16_t g_voltageX1000ToAdcCoeff;
+var uint16_t g_voltageX1000ToAdcRound;
+var uint16_t g_currentX1000ToAdcCoeff;
+var uint16_t g_currentX1000ToAdcRound;
+
+// Minimum and maximum voltage samples in the PID_MODE_MANUAL mode
+var volatile uint16_t g_adcTimingMin;
+var volatile uint16_t g_adcTimingMax;
+
 // *** ADC averager ***
 
 // ADC averager counter
@@ -50,13 +74,42 @@ var uint8_t g_adcAveragerCounter;
 var uint8_t g_adcAveragerVoltageAcc[3];
 var uint8_t g_adcAveragerCurrentAcc[3];
 
-// Average ADC voltage and current, 30.5 updates per second
+// The accumulators of the last 256 samples, taken by the timer interrupt before it enables
+// interrupts, so a nested interrupt adds its samples to the restarted accumulators
+var uint8_t g_adcAveragerVoltageSum[3];
+var uint8_t g_adcAveragerCurrentSum[3];
+
+// Average ADC voltage and current, 30.5 updates per second.
+// Use utils::GetAdcAverages() to read them.
 var volatile uint16_t g_adcVoltageAverage;
 var volatile uint16_t g_adcCurrentAverage;
 
+// High resolution (16 times the average scale) voltage and current, updated together
+// with the averages. Use utils::GetAdcDisplayValues() to read them filtered.
+var volatile uint16_t g_adcVoltageHiRes;
+var volatile uint16_t g_adcCurrentHiRes;
+
+// Incremented by the timer interrupt right after it updates the average values,
+// so they can be read without disabling interrupts
+var volatile uint8_t g_adcAverageSequence;
+
+// I^2*t overcurrent protection accumulator (24 bit) and the trip flag. The flag is
+// set by the timer interrupt and turned into FAILURE_OVERCURRENT by CheckForFailures().
+var uint8_t g_i2tAcc[3];
+var volatile uint8_t g_i2tTripped;
+
+// Fast channel IIR filter accumulators (2^ADC_FAST_FILTER_SHIFT times the filtered values),
+// updated every PID cycle. Use utils::GetAdcFastValues() to read them.
+var volatile uint16_t g_adcVoltageFastAcc;
+var volatile uint16_t g_adcCurrentFastAcc;
+
 // Total sum of every current value measured, 48 bit (for delivered capacity calculating)
 var uint8_t g_totalCurrentSum[6];
 
+// Total sum of the current values multiplied by the average voltage, 56 bit
+// (for delivered energy calculating, see energy_sum in timer_int.S)
+var uint8_t g_totalEnergySum[7];
+
 // *** Encoder ***
 
 // Last encoder pin state (for the main interrupt)
@@ -107,9 +160,42 @@ var volatile bool g_resetDisplay;
 // State of the temperature sensor request routine
 var uint8_t g_tempRequesterState;
 
-// Board and battery temprerature
-var uint16_t g_temperatureBoard;
-var uint16_t g_temperatureBattery;
+// Board and battery temprerature. Use utils::ReadU16() to read them.
+var volatile uint16_t g_temperatureBoard;
+var volatile uint16_t g_temperatureBattery;
+
+#ifdef DIAGNOSTICS
+
+// *** Diagnostics ***
+
+// Timer0 interrupt path statistics, filled by the ISR profiler in timer_int.S
+struct SIsrPathStats
+{
+    // Worst-case path length in CPU clocks
+    uint16_t m_max;
+
+    // Number of measurements and their sum since the last reset
+    // (the sum is not updated anymore once the counter reaches 0xFFFF)
+    uint16_t m_count;
+    uint32_t m_sum;
+};
+
+var SIsrPathStats g_isrStats[DIAG_PATH_COUNT];
+
+// Timer0 overflow counter and its value at the start of the eighth
+// and the fourth (PID_FAST_LOOP only) interrupts
+var uint8_t g_diagTicks;
+var uint8_t g_diag8thTick;
+var uint8_t g_diag4thTick;
+
+// TCNT0 value right after the ADC start of the current timer interrupt and its maximum
+var uint8_t g_diagAdcStartTcnt;
+var uint8_t g_diagAdcStartMax;
+
+// Set by the timer interrupt if its ADC path has overrun the 256-clock timer slot
+var bool g_diagSlotOverrun;
+
+#endif // DIAGNOSTICS
 
 // ***
 
@@ -119,6 +205,66 @@ struct SPsProfile
     uint16_t m_current;
 };
 
+// Maximum number of points in a calibration table
+#define CALIBRATION_POINTS 6
+
+// A calibration point: high resolution ADC value (16 times the ADC average scale) and
+// the real (measured by a meter) voltage or current in mV or mA
+struct SCalibrationPoint
+{
+    uint16_t m_hiResAdc;
+    uint16_t m_x1000;
+};
+
+// Piecewise-linear calibration table. If it has at least 2 points, it replaces the offset
+// and multiplier calibration values in the conversion routines. The first and the last
+// segments are extended to the whole range.
+struct SCalibrationTable
+{
+    // Number of points, they are sorted by the ADC value (and by the real value too)
+    uint8_t m_count;
+    SCalibrationPoint m_points[CALIBRATION_POINTS];
+
+    // Segment slopes, real value units per high resolution ADC unit, 0.16 fixed point
+    // (more than 1/256 and less than 0.5 so that the conversions fit 32 bits), and their
+    // reciprocals, 16.16 fixed point, for the conversions without division
+    uint16_t m_slopes[CALIBRATION_POINTS - 1];
+    uint32_t m_invSlopes[CALIBRATION_POINTS - 1];
+
+    bool IsUsed() const
+    {
+        return m_count >= 2;
+    }
+
+    // Adds a point (or replaces the one with a close ADC value). Returns false and doesn't
+    // change the table if it's full or the real values don't increase with the ADC values.
+    bool AddPoint(uint16_t hiResAdc, uint16_t x1000);
+
+    // Recalculates the slopes from the points (after the table is loaded), clears the table
+    // if the points are invalid
+    void Rebuild();
+
+    // Conversion routines, the table must be used
+    uint16_t HiResToX1000(uint16_t hiResAdc) const;
+    uint16_t X1000ToHiRes(uint16_t x1000) const;
+
+private:
+    bool UpdateSlopes();
+};
+
+// Settings slot header, written to the EEPROM at the slot end after the settings
+struct SSettingsHeader
+{
+    // Incremented with every save, the newest valid slot is loaded at startup
+    uint8_t m_sequence;
+
+    // CRC-16 of the sequence number and the settings
+    uint16_t m_crc;
+};
+
+// The settings are journaled: every save goes to the other EEPROM slot (so the wear is spread
+// over both of them), its header is written last. A slot torn by a power loss fails the CRC
+// check, and the previous settings are loaded from the other one.
 struct SSettings
 {
     // Key (encoder rotation and click) beep length and volume
@@ -168,8 +314,22 @@ struct SSettings
     // Additional power supply profiles (10 pcs)
     SPsProfile m_psProfiles[10];
 
-    // Magic number
-    static constexpr uint16_t MagicNumber = 0x1236;
+    // Feed-forward PWM value per ADC voltage unit, 8.8 fixed point (0 - feed-forward
+    // is disabled). Learned in the calibration screen, used to seed the PID when the
+    // output is switched on.
+    uint16_t m_pwmPerAdcVoltage;
+
+    // Bit N is set if the timer interrupt must start ADC conversions early (see timer_int.S)
+    // for the PWM values 0xN*8 00 - 0xN*8+7 FF. Bit 0 is ignored, the early start is never
+    // used for PWM values below 0x0800. Found by the ADC timing calibration.
+    uint32_t m_adcEarlyStartMap;
+
+    // Multi-point voltage and current calibration tables (empty by default)
+    SCalibrationTable m_voltageTable;
+    SCalibrationTable m_currentTable;
+
+    // Magic number, identifies the layout (see pm_settingsVersions in data.cpp)
+    static constexpr uint16_t MagicNumber = 0x123A;
     uint16_t m_magicNumber;
 
     // Measurement conversion routines
@@ -178,17 +338,60 @@ struct SSettings
     uint16_t DisplayX1000VoltageToAdc(uint16_t x1000Voltage);
     uint16_t DisplayX1000CurrentToAdc(uint16_t x1000Current);
 
-    static bool AreEepromSettingsValid();
+    // Same as Adc*ToDisplayX1000() for the high resolution values (16 times the ADC average scale)
+    uint16_t HiResVoltageToDisplayX1000(uint16_t hiResVoltage);
+    uint16_t HiResCurrentToDisplayX1000(uint16_t hiResCurrent);
+
+    // Same, but always use the offset and multiplier calibration values (not the tables)
+    uint16_t LinearHiResVoltageToDisplayX1000(uint16_t hiResVoltage);
+    uint16_t LinearHiResCurrentToDisplayX1000(uint16_t hiResCurrent);
+
+    // Passes m_adcEarlyStartMap to the timer interrupt
+    void ApplyAdcEarlyStartMap();
+
+    // Updates the DisplayX1000*ToAdc() coefficients, must be called after the voltage
+    // or current multiplier is changed
+    void UpdateConversionCoeffs();
+
+    // Loads the newest valid settings slot. The settings stored with an older layout are
+    // converted and saved. Returns false and doesn't change the settings if there is none.
     bool ReadFromEeprom();
+
+    // Queues the settings write to the next slot if they are changed, it's finished in the
+    // background (see eeprom::Write()). The settings are copied, so they can be changed right
+    // away. Waits for the previous save to be written.
     void SaveToEeprom();
     void ResetToDefault();
+
+    // Whether the settings differ from the last loaded or saved ones (compares the CRC)
     bool AreSettingsChanged();
 
+    // Called from Timer100Hz() only, i.e. from the eighth timer interrupt after it has
+    // published the ADC averages. Nothing can change them or the temperatures until it
+    // returns, so it reads them directly, without the interrupt-safe helpers.
     void SetFanSpeed();
 
+    // Returns the feed-forward PWM value for the given ADC voltage
+    uint16_t AdcVoltageToFeedForwardPwm(uint16_t adcVoltage);
+
 private:
-    static SSettings* GetEepromSettingsAddr();
+    static SSettings* GetEepromSettingsAddr(uint8_t slot);
+    static SSettingsHeader* GetEepromHeaderAddr(uint8_t slot);
+    static uint8_t FindEepromVersion(uint8_t slot);
+    static uint16_t GetEepromCrc(uint8_t slot, uint8_t sequence, uint8_t size);
+    uint16_t GetCrc(uint8_t sequence) const;
+
+    // Makes the slot written by SaveToEeprom() the current one once the write is finished
+    static void FinishEepromWrite();
 };
 
 var SSettings g_settings;
 
+// The slot of the last loaded or completely written settings and the slot headers
+var uint8_t g_settingsSlot;
+var SSettingsHeader g_settingsHeaders[EEPROM_SETTINGS_SLOTS];
+
+// The settings being written by SaveToEeprom() and their slot (0xFF - none)
+var SSettings g_settingsCopy;
+var uint8_t g_settingsWriteSlot;
+
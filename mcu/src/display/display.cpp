@@ -1,8 +1,9 @@
 #include "../includes.h"
 
-// Since font headers instantiate data, we can include them only once. Do it here
-#include "fonts/FreeSans12.h"
-#include "fonts/FreeSans18.h"
+// Since font headers instantiate data, we can include them only once. Do it here.
+// These are the fonts/ headers with the run-length encoded bitmaps (see gen_fonts.py)
+#include "FreeSans12_rle.h"
+#include "FreeSans18_rle.h"
 
 namespace display {
 
@@ -14,6 +15,9 @@ const char pm_overvoltage[] PROGMEM = "Output overvoltage\ndetected!\n"
     "This could be\nan internal failure.\nClick OK to reset";
 const char pm_overcurrent[] PROGMEM = "Output overcurrent\ndetected!\n"
     "This could be\nan internal failure.\nClick OK to reset";
+#ifdef DIAGNOSTICS
+static const char pm_slotOverrun[] PROGMEM = "Timer interrupt\noverran its\n256-clock slot!\nSee the diagnostics\nscreen";
+#endif
 const char pm_ok[] PROGMEM = "OK";
 const char pm_yes[] PROGMEM = "YES";
 const char pm_no[] PROGMEM = "NO";
@@ -151,6 +155,90 @@ uint8_t DrawSettableDecimal(uint8_t x, uint8_t y, uint8_t count, uint8_t cursorP
     return x;
 }
 
+// *** Widget cache ***
+
+void InvalidateWidgets()
+{
+    for (WidgetCache& widget: g_widgets)
+        widget.m_count = DISPLAY_WIDGET_INVALID;
+}
+
+bool IsWidgetChanged(uint8_t widget, uint8_t count, uint8_t state, uint16_t fgColor, uint16_t bgColor)
+{
+    if (count > DISPLAY_WIDGET_TEXT_SIZE)
+        return true;
+
+    WidgetCache& cache = g_widgets[widget];
+    bool changed = (cache.m_count != count || cache.m_state != state ||
+        cache.m_fgColor != fgColor || cache.m_bgColor != bgColor);
+
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        if (cache.m_text[i] != g_buffer[i])
+        {
+            cache.m_text[i] = g_buffer[i];
+            changed = true;
+        }
+    }
+
+    cache.m_count = count;
+    cache.m_state = state;
+    cache.m_fgColor = fgColor;
+    cache.m_bgColor = bgColor;
+    return changed;
+}
+
+uint8_t PrintStringRamDiff(uint8_t widget, uint8_t x, uint8_t y, const char* string, uint8_t count, uint8_t fillToX)
+{
+    WidgetCache& cache = g_widgets[widget];
+    bool redraw = true;
+    uint8_t oldX = x;
+
+    if (count > DISPLAY_WIDGET_TEXT_SIZE)
+    {
+        x = PrintStringRam(x, y, string, count);
+    }
+    else
+    {
+        redraw = (cache.m_count != count || cache.m_state != 0 ||
+            cache.m_fgColor != g_fgColor || cache.m_bgColor != g_bgColor);
+
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            // A glyph can be skipped only if it is the same and stays at the same place
+            // (a wider or narrower glyph before it shifts the rest of the string)
+            uint8_t c = string[i];
+            if (redraw || cache.m_text[i] != c || oldX != x)
+                PrintGlyph(g_font, x, y, c, g_fgColor, g_bgColor);
+
+            if (!redraw)
+                oldX += GetCharWidth(cache.m_text[i]);
+
+            cache.m_text[i] = c;
+            x += GetCharWidth(c);
+        }
+
+        cache.m_count = count;
+        cache.m_state = 0;
+        cache.m_fgColor = g_fgColor;
+        cache.m_bgColor = g_bgColor;
+    }
+
+    if (x < fillToX && (redraw || x < oldX))
+    {
+        int8_t yOffset = pgm_read_byte(&g_font->m_yFirstLineOffset);
+        FillRect(x, y + yOffset, fillToX - x, pgm_read_byte(&g_font->m_yAdvance), g_bgColor);
+    }
+
+    return x;
+}
+
+void DrawWidgetSettableDecimal(uint8_t widget, uint8_t x, uint8_t y, uint8_t count, uint8_t cursorPos, uint16_t fgColor, uint16_t bgColor)
+{
+    if (IsWidgetChanged(widget, count, cursorPos, fgColor, bgColor))
+        DrawSettableDecimal(x, y, count, cursorPos, fgColor, bgColor);
+}
+
 // *** Message box ***
 
 uint8_t MessageBox(const char* caption, const char* text, uint8_t flags)
@@ -330,6 +418,19 @@ uint8_t MessageBox(const char* caption, const char* text, uint8_t flags)
 bool ProcessFailureStates()
 {
     bool result = false;
+#ifdef DIAGNOSTICS
+    // ISR profiler assertion. MessageBox() calls us back, so don't show it twice.
+    static bool slotOverrunShown = false;
+    if (g_diagSlotOverrun && !slotOverrunShown)
+    {
+        slotOverrunShown = true;
+        display::MessageBox(display::pm_failure, pm_slotOverrun, MB_ERROR | MB_OK);
+        g_diagSlotOverrun = false;
+        slotOverrunShown = false;
+        result = true;
+    }
+#endif
+
     for (;;)
     {
         if (g_failureState & FAILURE_NONE)
@@ -346,7 +447,8 @@ bool ProcessFailureStates()
 
         if (g_failureState & FAILURE_POWER_LOW)
         {
-            // Try to save settings first
+            // Try to save settings first. The write goes on in the background while
+            // the message box is drawn and we sleep.
             g_settings.SaveToEeprom();
 
             display::MessageBox(display::pm_warning, pm_lowPower, MB_WARNING);
@@ -396,7 +498,18 @@ int8_t UiScreen::DrawBackground() const
 void UiScreen::DrawElements(int8_t cursorPosition, uint8_t ticksElapsed) const
 {
     UiDrawElementsFunc func = reinterpret_cast<UiDrawElementsFunc>(pgm_read_word(&m_drawElementsFunc));
+#ifdef DIAGNOSTICS
+    uint32_t pixels = g_pixelsPushed;
+    func(cursorPosition, ticksElapsed);
+
+    pixels = g_pixelsPushed - pixels;
+    if (pixels > g_maxFramePixels)
+        g_maxFramePixels = pixels;
+
+    ++g_frameCounter;
+#else
     func(cursorPosition, ticksElapsed);
+#endif
 }
 
 bool UiScreen::OnClickElement(int8_t cursorPosition) const
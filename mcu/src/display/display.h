@@ -78,7 +78,8 @@ struct Font
 
     // Font glyph bitmaps, concatenated. The bitmaps have 1 bit depth and are
     // stored in the left-right-up-down order, MSB first. Each glyph starts from
-    // bit 7 of its own byte
+    // bit 7 of its own byte. The build run-length encodes them for PrintGlyph
+    // (see gen_fonts.py)
     uint8_t m_bitmaps[];
 };
 
@@ -117,6 +118,47 @@ uint8_t DrawSettableDecimal(uint8_t x, uint8_t y, uint8_t count, uint8_t cursorP
 #define DSD_CURSOR_SKIP 0x80
 #define DSD_CURSOR_HIDDEN 0x40
 
+// *** Widget cache ***
+
+// Screens which redraw their elements on every DrawElements() call can skip the widgets
+// (text fields, indicators, etc.) that haven't changed since they were drawn last time.
+// Every such widget has its own number and must always be drawn at the same place with
+// the same font. The cache remembers the last widget text, colors and state.
+struct WidgetCache
+{
+    // Last widget text
+    char m_text[DISPLAY_WIDGET_TEXT_SIZE];
+
+    // Text length or DISPLAY_WIDGET_INVALID if the widget must be redrawn
+    uint8_t m_count;
+
+    // Any other widget state (cursor position, etc.)
+    uint8_t m_state;
+
+    uint16_t m_fgColor;
+    uint16_t m_bgColor;
+};
+
+#define DISPLAY_WIDGET_INVALID 0xFF
+
+// Marks all widgets for redrawing. Must be called when the screen background is (re)drawn.
+void InvalidateWidgets();
+
+// Returns true if the widget must be redrawn, i.e. count characters of g_buffer, the colors or
+// the state differ from the ones the widget was drawn with last time, and remembers the new
+// ones. Widgets with more than DISPLAY_WIDGET_TEXT_SIZE characters are always redrawn.
+bool IsWidgetChanged(uint8_t widget, uint8_t count, uint8_t state, uint16_t fgColor, uint16_t bgColor);
+
+// Prints count characters of string like PrintStringRam() does, but redraws only the glyphs
+// which differ from the ones the widget was drawn with last time (or all of them if the colors
+// have changed). If fillToX is not zero, the space between the end of the string and fillToX is
+// filled with the background color when the string gets shorter. Returns x coordinate where
+// the next symbol can be printed.
+uint8_t PrintStringRamDiff(uint8_t widget, uint8_t x, uint8_t y, const char* string, uint8_t count, uint8_t fillToX);
+
+// Same as DrawSettableDecimal(), but does nothing if the widget hasn't changed
+void DrawWidgetSettableDecimal(uint8_t widget, uint8_t x, uint8_t y, uint8_t count, uint8_t cursorPos, uint16_t fgColor, uint16_t bgColor);
+
 // Displays a message box with the specified caption and text (both located in the program memory).
 // Caption must be a single line string, whereas text can be multiline. The '\n' symbol is used
 // as line breaks.
@@ -289,6 +331,18 @@ var Font const* g_font;
 var uint16_t g_fgColor;
 var uint16_t g_bgColor;
 
+// Widget cache
+var WidgetCache g_widgets[DISPLAY_WIDGET_COUNT];
+
+#ifdef DIAGNOSTICS
+// Number of DrawElements() calls and pixels sent to the display (both wrap around)
+var uint16_t g_frameCounter;
+var uint32_t g_pixelsPushed;
+
+// Maximum number of pixels sent by a single DrawElements() call
+var uint32_t g_maxFramePixels;
+#endif
+
 } // extern "C"
 
 } // namespace display
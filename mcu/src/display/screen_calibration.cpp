@@ -19,6 +19,8 @@ void UpdateTargetValues()
 {
     g_pidTargetVoltage = g_settings.DisplayX1000VoltageToAdc(g_voltageX1000);
     g_pidTargetCurrent = g_settings.DisplayX1000CurrentToAdc(g_currentX1000);
+    g_pidKp = DEFAULT_PID_KP;
+    g_pidKi = DEFAULT_PID_KI;
 }
 
 int8_t DrawBackground()
@@ -64,12 +66,28 @@ int8_t DrawBackground()
     return 0;
 }
 
+// Converts x1000 voltage or current to the XX.XXX or X.XXX string (6 or 5 chars), the
+// maximum resolution of the calibration screen
+void HiResValueToString(uint16_t x1000, bool isCurrent)
+{
+    utils::I16ToString(x1000, g_buffer, 1);
+    if (isCurrent)
+    {
+        g_buffer[0] = g_buffer[1];
+        g_buffer[1] = '.';
+        return;
+    }
+
+    g_buffer[5] = g_buffer[4];
+    g_buffer[4] = g_buffer[3];
+    g_buffer[3] = g_buffer[2];
+    g_buffer[2] = '.';
+}
+
 void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
 {
-    cli();
-    uint16_t voltage = g_adcVoltageAverage;
-    uint16_t current = g_adcCurrentAverage;
-    sei();
+    uint16_t voltage, current;
+    utils::GetAdcDisplayValues(voltage, current);
 
     display::SetSans12();
 
@@ -112,23 +130,16 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
 
     // Voltage
     // In the calibration screen we need to display voltage and current
-    // with the maximum possible resolution
+    // with the maximum possible resolution. The calibration tables are not used
+    // here, the table points take the meter readings (see AddCalibrationPoint()).
     display::SetSans18();
     display::SetColors(CLR_DARK_BLUE, CLR_VOLTAGE);
-    voltage = g_settings.AdcVoltageToDisplayX1000(voltage);
-    utils::I16ToString(voltage, g_buffer, 1);
-    g_buffer[5] = g_buffer[4];
-    g_buffer[4] = g_buffer[3];
-    g_buffer[3] = g_buffer[2];
-    g_buffer[2] = '.';
+    HiResValueToString(g_settings.LinearHiResVoltageToDisplayX1000(voltage), false);
     display::PrintStringRam(10, 231, g_buffer, 6);
 
     // Current
     display::SetColor(CLR_CURRENT);
-    current = g_settings.AdcCurrentToDisplayX1000(current);
-    utils::I16ToString(current, g_buffer, 1);
-    g_buffer[0] = g_buffer[1];
-    g_buffer[1] = '.';
+    HiResValueToString(g_settings.LinearHiResCurrentToDisplayX1000(current), true);
     display::PrintStringRam(240 - 10 - 23 - 19*3 - 9, 231, g_buffer, 5);
 }
 
@@ -150,6 +161,7 @@ void OnChangeValue(int8_t cursorPosition, int8_t delta)
     {
         g_settings.m_voltage4096Value =
             utils::ChangeI16ByDigit(g_settings.m_voltage4096Value, UI_VOLTAGE_MULT5 - cursorPosition, delta, 18000, 30000);
+        g_settings.UpdateConversionCoeffs();
     }
     else if (cursorPosition == UI_VOLTAGE_OFS)
     {
@@ -164,6 +176,7 @@ void OnChangeValue(int8_t cursorPosition, int8_t delta)
     {
         g_settings.m_current4096Value =
             utils::ChangeI16ByDigit(g_settings.m_current4096Value, UI_CURRENT_MULT5 - cursorPosition, delta, 8000, 16000);
+        g_settings.UpdateConversionCoeffs();
     }
     else if (cursorPosition == UI_CURRENT_OFS)
     {
@@ -174,27 +187,268 @@ void OnChangeValue(int8_t cursorPosition, int8_t delta)
     UpdateTargetValues();
 }
 
+// Learns the feed-forward PWM value per ADC voltage unit from the PWM value
+// the PID holds in the CV mode
+void LearnFeedForward()
+{
+    static const char pm_learnTitle[] PROGMEM = "Feed-forward";
+    static const char pm_learnNotCv[] PROGMEM = "Set the output to\nthe CV mode (at\nleast 5 V) first.";
+    static const char pm_learnDone[] PROGMEM = "PWM ratio learned.\nSave the settings\nto keep it.";
+
+    if (g_pidMode != PID_MODE_CV || g_voltageX1000 < 5000)
+    {
+        display::MessageBox(pm_learnTitle, pm_learnNotCv, MB_ERROR | MB_OK);
+        return;
+    }
+
+    // Average the PWM value over 160 ms
+    uint32_t pwmSum = 0;
+    for (uint8_t i = 0; i < 16; ++i)
+    {
+        utils::Delay(1);
+        cli();
+        pwmSum += g_pwmValue;
+        sei();
+    }
+
+    g_settings.m_pwmPerAdcVoltage = static_cast<uint16_t>((pwmSum << 4)/g_pidTargetVoltage);
+    display::MessageBox(pm_learnTitle, pm_learnDone, MB_INFO | MB_OK);
+}
+
+// Finds the least noisy ADC sampling instant (the normal or the early start section of the
+// timer interrupt) for every 8 values of the PWM high byte. The PWM value is swept in the open
+// loop mode, and the one with the smaller voltage sample spread wins. The sweep stops before
+// the output voltage exceeds MAX_VOLTAGE.
+void TuneAdcTiming()
+{
+    static const char pm_tuneTitle[] PROGMEM = "ADC timing";
+    static const char pm_tuneLoad[] PROGMEM = "Connect a 20 Ohm\nload. The output\nsweeps up to 24 V.";
+    static const char pm_tuneDone[] PROGMEM = "ADC timing tuned.\nSave the settings\nto keep it.";
+
+    if (display::MessageBox(pm_tuneTitle, pm_tuneLoad, MB_WARNING | MB_YESNO | MB_DEFAULT_NO) != 0)
+        return;
+
+    // The PID doesn't control the output, but keep the voltage target at the limit and the
+    // current target at 0, so the overvoltage check still switches the output off if the
+    // voltage goes above it
+    uint16_t maxVoltage = g_settings.DisplayX1000VoltageToAdc(MAX_VOLTAGE);
+    g_pidTargetVoltage = maxVoltage;
+    g_pidTargetCurrent = 0;
+
+    uint32_t map = g_settings.m_adcEarlyStartMap;
+    bool earlyStart = false;
+    uint16_t voltage = 0, current;
+    uint16_t lastPwm = 0;
+    uint8_t range = 1;
+    for (; range < 32; ++range)
+    {
+        // Middle of the range. The open loop output voltage is proportional to the PWM value,
+        // so don't step over the limit if the voltage of the previous range predicts it.
+        uint16_t pwm = (static_cast<uint16_t>(range) << 11) | 0x0400;
+        if (lastPwm && static_cast<uint32_t>(voltage)*pwm/lastPwm >= maxVoltage)
+            break;
+
+        uint16_t spread[2];
+        bool limitReached = false;
+        for (uint8_t i = 0; i < 2; ++i)
+        {
+            cli();
+            g_pwmValue = pwm;
+            if (i)
+                GPIOR0 |= BV(GPIOR0_ADC_EARLY_START);
+            else
+                GPIOR0 &= ~BV(GPIOR0_ADC_EARLY_START);
+            g_pidMode = PID_MODE_MANUAL;
+            sei();
+            utils::Delay(2);
+
+            cli();
+            g_adcTimingMin = 0xFFFF;
+            g_adcTimingMax = 0;
+            sei();
+            utils::Delay(5);
+
+            // A failure has switched the output off
+            if (g_pidMode != PID_MODE_MANUAL)
+            {
+                UpdateTargetValues();
+                return;
+            }
+
+            // Stop right away if the limit is reached anyway
+            utils::GetAdcFastValues(voltage, current);
+            if (voltage >= maxVoltage)
+            {
+                limitReached = true;
+                break;
+            }
+
+            cli();
+            spread[i] = g_adcTimingMax - g_adcTimingMin;
+            sei();
+        }
+
+        if (limitReached)
+            break;
+
+        // On a tie keep the previous range choice
+        if (spread[0] != spread[1])
+            earlyStart = spread[1] < spread[0];
+
+        if (earlyStart)
+            map |= static_cast<uint32_t>(1) << range;
+        else
+            map &= ~(static_cast<uint32_t>(1) << range);
+
+        lastPwm = pwm;
+    }
+
+    // The output voltage limit is reached, use the last choice for the rest of the ranges
+    for (; range < 32; ++range)
+    {
+        if (earlyStart)
+            map |= static_cast<uint32_t>(1) << range;
+        else
+            map &= ~(static_cast<uint32_t>(1) << range);
+    }
+
+    UpdateTargetValues();
+    cli();
+    g_pwmValue = 0;
+    GPIOR0 &= ~BV(GPIOR0_ADC_EARLY_START);
+    g_pidIntegral[0] = g_pidIntegral[1] = g_pidIntegral[2] = 0;
+    g_pidMode = PID_MODE_OFF;
+    sei();
+
+    g_settings.m_adcEarlyStartMap = map;
+    g_settings.ApplyAdcEarlyStartMap();
+    display::MessageBox(pm_tuneTitle, pm_tuneDone, MB_INFO | MB_OK);
+}
+
+// Lets the users enter the meter reading in the bottom panel, starting from x1000. The encoder
+// changes the highlighted digit, a click moves to the next digit and a long click finishes
+// the entry.
+uint16_t EnterMeterReading(uint16_t x1000, bool isCurrent)
+{
+    static const char pm_meter[] PROGMEM = "Meter:";
+
+    uint8_t digitCount = isCurrent ? 4 : 5;
+    uint8_t x = isCurrent ? 240 - 10 - 16 - 13*4 - 6 : 240 - 10 - 15 - 13*5 - 6;
+
+    display::FillRect(2, 200, 236, 40, CLR_DARK_BLUE);
+    display::SetSans12();
+    display::SetColors(CLR_DARK_BLUE, CLR_WHITE);
+    display::PrintString(10, 226, pm_meter);
+    display::PrintGlyph(isCurrent ? 240 - 10 - 16 : 240 - 10 - 15, 226, isCurrent ? 'A' : 'V');
+
+    utils::ClearPendingKeys();
+    uint8_t digit = 0;
+    bool changed = true;
+    for (;;)
+    {
+        if (changed)
+        {
+            HiResValueToString(x1000, isCurrent);
+            display::DrawSettableDecimal(x, 226, digitCount + 1, digit, CLR_WHITE, CLR_DARK_BLUE);
+            changed = false;
+        }
+
+        EEncoderKey key = utils::GetEncoderKey();
+        if (key == EEncoderKey::UpLong)
+            return x1000;
+
+        if (key == EEncoderKey::Up)
+        {
+            if (++digit == digitCount)
+                digit = 0;
+
+            changed = true;
+        }
+
+        int8_t delta = utils::GetEncoderDelta();
+        if (delta)
+        {
+            x1000 = utils::ChangeI16ByDigit(x1000, digitCount - 1 - digit, delta, 0, isCurrent ? 9999 : 0xFFFF);
+            changed = true;
+        }
+    }
+}
+
+// Adds the current measurement to the voltage or current calibration table. The real value
+// of the point is the meter reading entered by the users, the multiplier and offset (which
+// the timer interrupt also uses to integrate the capacity and energy) are not involved.
+void AddCalibrationPoint(bool isCurrent)
+{
+    static const char pm_pointTitle[] PROGMEM = "Calibration point";
+    static const char pm_pointConfirm[] PROGMEM = "Add the point with\nthe entered meter\nreading?";
+    static const char pm_pointAdded[] PROGMEM = "Point added. Save\nthe settings to\nkeep it.";
+    static const char pm_pointError[] PROGMEM = "The table is full\nor the point breaks\nits monotonicity.";
+
+    uint16_t voltage, current;
+    utils::GetAdcDisplayValues(voltage, current);
+
+    uint16_t hiResAdc = isCurrent ? current : voltage;
+    uint16_t x1000 = EnterMeterReading(isCurrent ?
+        g_settings.LinearHiResCurrentToDisplayX1000(current) :
+        g_settings.LinearHiResVoltageToDisplayX1000(voltage), isCurrent);
+
+    if (display::MessageBox(pm_pointTitle, pm_pointConfirm, MB_INFO | MB_YESNO) != 0)
+        return;
+
+    bool added = isCurrent ?
+        g_settings.m_currentTable.AddPoint(hiResAdc, x1000) :
+        g_settings.m_voltageTable.AddPoint(hiResAdc, x1000);
+
+    UpdateTargetValues();
+    if (added)
+        display::MessageBox(pm_pointTitle, pm_pointAdded, MB_INFO | MB_OK);
+    else
+        display::MessageBox(pm_pointTitle, pm_pointError, MB_ERROR | MB_OK);
+}
+
 bool OnLongClick(int8_t cursorPosition)
 {
     static const char pm_menuTitle[] PROGMEM = "Calibration menu";
     static const char pm_menu0[] PROGMEM = "Return";
     static const char pm_menu1[] PROGMEM = "Reset values";
-    static const char pm_menu2[] PROGMEM = "Save and exit";
+    static const char pm_menu2[] PROGMEM = "Learn PWM ratio";
+    static const char pm_menu3[] PROGMEM = "Tune ADC timing";
+    static const char pm_menu4[] PROGMEM = "Add voltage point";
+    static const char pm_menu5[] PROGMEM = "Add current point";
+    static const char pm_menu6[] PROGMEM = "Clear cal. points";
+    static const char pm_menu7[] PROGMEM = "Save and exit";
     static const display::Menu pm_menu PROGMEM =
     {
         nullptr, nullptr, nullptr,
-        3,
+        8,
         pm_menuTitle,
         pm_menu0,
         pm_menu1,
         pm_menu2,
+        pm_menu3,
+        pm_menu4,
+        pm_menu5,
+        pm_menu6,
+        pm_menu7,
     };
     uint8_t item = pm_menu.Show();
-    if (item == 2)
+    if (item == 7)
         return true;
 
     if (item == 1)
         g_settings.ReadFromEeprom();
+    else if (item == 2)
+        LearnFeedForward();
+    else if (item == 3)
+        TuneAdcTiming();
+    else if (item == 4 || item == 5)
+        AddCalibrationPoint(item == 5);
+    else if (item == 6)
+    {
+        g_settings.m_voltageTable.m_count = 0;
+        g_settings.m_currentTable.m_count = 0;
+        UpdateTargetValues();
+    }
 
     DrawBackground();
     return false;
@@ -0,0 +1,202 @@
+#include "../includes.h"
+
+namespace screen::history {
+
+using ::charger::g_tempProfile;
+
+constexpr uint8_t YHeader = 23;
+constexpr uint8_t YResult = 56;
+constexpr uint8_t YProfile = 84;
+constexpr uint8_t YCapacity = 112;
+constexpr uint8_t YEnergy = 140;
+constexpr uint8_t YVoltage = 168;
+constexpr uint8_t YResistance = 196;
+constexpr uint8_t YTemperature = 224;
+
+constexpr uint8_t XValue = 112;
+
+int8_t DrawBackground()
+{
+    static const uint8_t pm_bgObjects[] PROGMEM =
+    {
+        DRO_FILLRECT | 1, 0, 0, 240, 30,
+        DRO_STR(7, YHeader, S, "CHARGE HISTORY", 14),
+
+        DRO_BGCOLOR(CLR_BLACK),
+        DRO_FILLRECT | 1, 0, 30, 240, 210,
+
+        DRO_FGCOLOR(CLR_GRAY),
+        DRO_STR(7, YCapacity, S, "Capacity:", 9),
+        DRO_STR(7, YEnergy, S, "Energy:", 7),
+        DRO_STR(7, YVoltage, S, "Voltage:", 8),
+        DRO_STR(7, YResistance, S, "Resistance:", 11),
+        DRO_STR(7, YTemperature, S, "Max temp:", 9),
+        DRO_END
+    };
+    display::DrawObjects(pm_bgObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
+
+    g_shownRecord = 0xFF;
+    return 0;
+}
+
+// Prints the temperature in degrees with the sensor symbol, returns the next x position
+uint8_t PrintTemperature(uint8_t x, char symbol, int8_t temperature)
+{
+    g_buffer[0] = symbol;
+    display::PrintStringRam(x, YTemperature, g_buffer, 1);
+
+    // Two digits are enough, the charger doesn't work above 99 degrees anyway
+    if (temperature < 0)
+        temperature = 0;
+    else if (temperature > 99)
+        temperature = 99;
+
+    utils::I8ToStringSpaces(static_cast<uint8_t>(temperature));
+    g_buffer[3] = 0x80;
+    return display::PrintStringRam(x + 16, YTemperature, g_buffer + 1, 3);
+}
+
+void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
+{
+    // Every cursor position is a record, the newest one first
+    uint8_t n = cursorPosition & ~(DSD_CURSOR_HIDDEN | DSD_CURSOR_SKIP);
+    if (n == g_shownRecord)
+        return;
+
+    g_shownRecord = n;
+    display::SetSans12();
+
+    display::SetColors(CLR_RED_BEAUTIFUL, CLR_WHITE);
+    utils::I8ToString(n + 1, g_buffer);
+    g_buffer[3] = '/';
+    g_buffer[4] = '0' + EEPROM_SESSIONS_COUNT;
+    display::PrintStringRam(240 - 7 - 13*2 - 7, YHeader, g_buffer + 2, 3);
+
+    display::FillRect(0, 32, 240, YProfile + 6 - 32, CLR_BLACK);
+    display::FillRect(XValue, YCapacity - 21, 240 - XValue, 240 - YCapacity + 21, CLR_BLACK);
+
+    charge_log::SRecord record;
+    if (!charge_log::ReadRecord(n, record))
+    {
+        static const char pm_noRecord[] PROGMEM = "No record";
+        display::SetColors(CLR_BLACK, CLR_GRAY);
+        display::PrintString((240 - display::GetTextWidth(pm_noRecord))/2, YProfile, pm_noRecord);
+        return;
+    }
+
+    // Result and charge time
+    static const char pm_complete[] PROGMEM = "Complete";
+    static const char pm_interrupted[] PROGMEM = "Interrupted";
+    static const char pm_batteryError[] PROGMEM = "Battery error";
+    static const char pm_stopped[] PROGMEM = "Stopped";
+
+    const char* result = pm_stopped;
+    uint16_t color = CLR_GRAY;
+    if (record.m_result == SESSION_COMPLETE)
+    {
+        result = pm_complete;
+        color = CLR_GREEN;
+    }
+    else if (record.m_result == SESSION_INTERRUPTED)
+    {
+        result = pm_interrupted;
+        color = CLR_WATTAGE;
+    }
+    else if (record.m_result == SESSION_BATTERY_ERROR)
+    {
+        result = pm_batteryError;
+        color = CLR_RED;
+    }
+
+    display::SetColors(CLR_BLACK, color);
+    display::PrintString(7, YResult, result);
+
+    display::SetColor(CLR_WHITE);
+    utils::I16ToString(record.m_minutes/60, g_buffer, 4);
+    utils::I8ToString(record.m_minutes % 60, g_buffer + 5);
+    g_buffer[5] = ':';
+    display::PrintStringRam(240 - 7 - 13*5 - 6, YResult, g_buffer + 2, 6);
+
+    // Profile name, or its number if the profile has been renamed or replaced since then
+    g_tempProfile.LoadFromEeprom(record.m_profileNumber);
+    if (charge_log::GetNameHash(g_tempProfile.m_name, g_tempProfile.m_nameLength) ==
+        record.m_profileNameHash)
+    {
+        uint8_t width = display::GetTextWidthRam(g_tempProfile.m_name, g_tempProfile.m_nameLength);
+        display::PrintStringRam((240 - width)/2, YProfile, g_tempProfile.m_name,
+            g_tempProfile.m_nameLength);
+    }
+    else
+    {
+        static const char pm_profile[] PROGMEM = "Profile ";
+        uint8_t number = record.m_profileNumber + 1;
+        uint8_t digits = number < 10 ? 1 : 2;
+        utils::I8ToString(number, g_buffer);
+        uint8_t width = display::GetTextWidth(pm_profile) +
+            display::GetTextWidthRam(g_buffer + 3 - digits, digits);
+        uint8_t x = display::PrintString((240 - width)/2, YProfile, pm_profile);
+        display::PrintStringRam(x, YProfile, g_buffer + 3 - digits, digits);
+    }
+
+    // XX.XXXAh
+    utils::I16ToString(record.m_capacityX1000, g_buffer, 1);
+    g_buffer[5] = g_buffer[4];
+    g_buffer[4] = g_buffer[3];
+    g_buffer[3] = g_buffer[2];
+    g_buffer[2] = '.';
+    g_buffer[6] = 'A';
+    g_buffer[7] = 'h';
+    display::PrintStringRam(XValue, YCapacity, g_buffer, 8);
+
+    // XXX.XXWh
+    utils::I16ToString(record.m_energyX100, g_buffer, 2);
+    g_buffer[5] = g_buffer[4];
+    g_buffer[4] = g_buffer[3];
+    g_buffer[3] = '.';
+    g_buffer[6] = 'W';
+    g_buffer[7] = 'h';
+    display::PrintStringRam(XValue, YEnergy, g_buffer, 8);
+
+    utils::VoltageToString(record.m_voltageX1000, true);
+    display::PrintStringRam(XValue, YVoltage, g_buffer, 6);
+
+    if (record.m_resistance)
+    {
+        utils::ResistanceToString(record.m_resistance, 0);
+        display::PrintStringRam(XValue, YResistance, g_buffer, 5);
+    }
+
+    uint8_t x = PrintTemperature(XValue, TEMP_BATTERY_SYMBOL, record.m_maxBatteryTemp);
+    PrintTemperature(x + 8, TEMP_BOARD_SYMBOL, record.m_maxBoardTemp);
+}
+
+bool OnClick(int8_t cursorPosition)
+{
+    return false;
+}
+
+void OnChangeValue(int8_t cursorPosition, int8_t delta)
+{
+}
+
+bool OnLongClick(int8_t cursorPosition)
+{
+    return true;
+}
+
+static const display::UiScreen pm_historyScreen PROGMEM =
+{
+    EEPROM_SESSIONS_COUNT,
+    &DrawBackground,
+    &DrawElements,
+    &OnClick,
+    &OnChangeValue,
+    &OnLongClick
+};
+
+void Show()
+{
+    pm_historyScreen.Show();
+}
+
+} // namespace screen::history
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "../data.h"
+
+namespace screen::history {
+
+// Record shown by DrawElements() (0xFF - none)
+var uint8_t g_shownRecord;
+
+void Show();
+
+} // namespace screen::history
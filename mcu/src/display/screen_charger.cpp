@@ -7,6 +7,11 @@ using ::charger::g_tempProfile;
 
 #define CHARGE_BAR_WIDTH 7
 
+// The output is switched off to measure the battery voltage once in this number
+// of 10-second charge cycles. In the other cycles the resting voltage is estimated
+// using the battery internal resistance.
+#define OFF_CYCLE_PERIOD 6
+
 #define UI_ELEMENT_COUNT 7
 
 #define UI_CCCMODE 0
@@ -17,6 +22,24 @@ using ::charger::g_tempProfile;
 #define UI_OPT_CHARGE_RESTART 5
 #define UI_BATTERY_ERROR_CONTINUE 6
 
+// Cached widgets. The state dependent ones are shared by the states since
+// the background is erased on every state change.
+#define WG_STATE_OBJECTS 0
+#define WG_VOLTAGE 1
+#define WG_CURRENT 2
+#define WG_WATTAGE 3
+#define WG_CAPACITY 4
+#define WG_CHARGE_PERCENT 5
+#define WG_TEMP_BATTERY 6
+#define WG_CONTINUE 7
+#define WG_TEMP_BOARD 8
+#define WG_ERROR_FLAG 9
+#define WG_TIME 10
+#define WG_SET_CURRENT 11
+#define WG_CHARGE_MODE 12
+#define WG_OPT_MAKITA_PROTO 13
+#define WG_OPT_CHARGE_RESTART 14
+
 constexpr uint8_t ChargeModeYPos = 54;
 constexpr uint8_t CurrentYPos = 81;
 constexpr uint8_t ChargeOptionsYPos = 108;
@@ -122,14 +145,18 @@ void SetNoBatteryOuputValues()
     uint16_t correction = g_settings.AdcCurrentToDisplayX1000(0);
     g_openCurrentCorrected = g_profile.m_openCurrentX1000 + correction;
     g_pidTargetCurrent = g_settings.DisplayX1000CurrentToAdc(g_openCurrentCorrected);
+    g_profile.SetPidGains();
     g_batteryChargePercent = g_batteryChargePixels = 0;
     g_outOn = true;
 }
 
 void SetWorkingOutputValues()
 {
+    // Threshold = current*percent/100, the percent is scaled by 65536/100 (0.16 fixed point,
+    // 41943 = 4194304/100) to avoid a division
+    uint32_t ratio = (static_cast<uint32_t>(g_profile.m_stopChargeCurrentPercent)*41943 + 32) >> 6;
     g_chargeFinishCurrentThreshold = static_cast<uint16_t>(
-        (static_cast<uint32_t>(g_profile.m_chargeCurrentX1000)*g_profile.m_stopChargeCurrentPercent)/100
+        (static_cast<uint32_t>(g_profile.m_chargeCurrentX1000)*ratio + 32768) >> 16
     );
 
     g_noBatteryThresholdCurrent = g_openCurrentCorrected;
@@ -139,6 +166,7 @@ void SetWorkingOutputValues()
     g_pidTargetVoltage = g_settings.DisplayX1000VoltageToAdc(
         (g_profile.m_options & COPT_CCC_MODE) ? 24000 : g_profile.m_chargeVoltageX1000);
     g_pidTargetCurrent = g_settings.DisplayX1000CurrentToAdc(g_profile.m_chargeCurrentX1000);
+    g_profile.SetPidGains();
 } 
 
 void Init()
@@ -179,6 +207,7 @@ int8_t DrawBackground()
     uint8_t width = display::GetTextWidthRam(g_profile.m_name, g_profile.m_nameLength);
     display::PrintStringRam((240 - width)/2, 233, g_profile.m_name, g_profile.m_nameLength);
     display::SetBgColor(CLR_BLACK);
+    display::InvalidateWidgets();
 
     return DSD_CURSOR_HIDDEN;
 }
@@ -191,6 +220,51 @@ void EraseBackground()
         {2, 117, 236, 67},
     };
     display::FillRects(pm_eraseBgRects, 2, CLR_BLACK);
+    display::InvalidateWidgets();
+}
+
+// Estimates the current battery charge in percents and pixels (to draw the battery icon)
+// using the following formula:
+// Charge% = (voltage - minVoltage)/(maxVoltage - minVoltage)*100
+void UpdateBatteryCharge(uint16_t voltage)
+{
+    if (voltage >= g_profile.m_minBatteryVoltageX1000)
+    {
+        uint16_t maxDv = g_profile.m_chargeVoltageX1000 - g_profile.m_minBatteryVoltageX1000;
+        uint32_t dv = voltage - g_profile.m_minBatteryVoltageX1000;
+        g_batteryChargePercent = static_cast<uint8_t>(dv*100/maxDv);
+        g_batteryChargePixels = static_cast<uint8_t>(dv*78/maxDv);
+        if (g_batteryChargePercent > 100)
+        {
+            g_batteryChargePercent = 100;
+            g_batteryChargePixels = 78;
+        }
+    }
+    else
+    {
+        g_batteryChargePercent = 0;
+        g_batteryChargePixels = 0;
+    }
+}
+
+// Sets the new internal resistance estimate and updates its trend
+// (changes below ~3% are considered as stable)
+void SetBatteryResistance(uint16_t resistance)
+{
+    uint16_t previous = g_batteryResistance;
+    int16_t delta = static_cast<int16_t>(resistance - previous);
+    int16_t band = static_cast<int16_t>(previous >> 5);
+
+    if (!previous)
+        g_batteryResistanceTrend = 0;
+    else if (delta > band)
+        g_batteryResistanceTrend = 1;
+    else if (delta < -band)
+        g_batteryResistanceTrend = -1;
+    else
+        g_batteryResistanceTrend = 0;
+
+    g_batteryResistance = resistance;
 }
 
 EState StateMachine(EState state, uint16_t voltage, uint16_t current)
@@ -201,13 +275,18 @@ EState StateMachine(EState state, uint16_t voltage, uint16_t current)
     {
         utils::TimeCapacityReset();
         SetWorkingOutputValues();
+        g_batteryResistance = 0;
+        g_batteryResistanceTrend = 0;
+        g_loadedCurrent = 0;
         g_batteryChargeBarPosition = -CHARGE_BAR_WIDTH;
+        charge_log::StartSession();
         sound::PlayMusic(g_settings.m_chargeStartMusic);
         return EState::MEASURING_VOLTAGE;
     };
 
     const auto FinishCharge = [&]() -> EState
     {
+        charge_log::FinishSession(SESSION_COMPLETE, g_batteryResistance);
         sound::PlayMusic(g_settings.m_chargeEndMusic);
         return EState::CHARGE_COMPLETE;
     };
@@ -256,6 +335,7 @@ EState StateMachine(EState state, uint16_t voltage, uint16_t current)
     const auto BatteryError = [&]() -> EState
     {
         g_outOn = false;
+        charge_log::FinishSession(SESSION_BATTERY_ERROR, g_batteryResistance);
         sound::PlayMusic(g_settings.m_batteryErrorMusic);
         return EState::BATTERY_ERROR;
     };
@@ -327,27 +407,24 @@ EState StateMachine(EState state, uint16_t voltage, uint16_t current)
         if (ticksInState < 10)
             return EState::DO_NOTHING;
 
-        // Estimate the current battery charge in percents and pixels (to draw the battery icon) using
-        // the following formula:
-        // Charge% = (voltage - minVoltage)/(maxVoltage - maxVoltage)*100
-        if (voltage >= g_profile.m_minBatteryVoltageX1000)
-        {
-            uint16_t maxDv = g_profile.m_chargeVoltageX1000 - g_profile.m_minBatteryVoltageX1000;
-            uint32_t dv = voltage - g_profile.m_minBatteryVoltageX1000;
-            g_batteryChargePercent = static_cast<uint8_t>(dv*100/maxDv);
-            g_batteryChargePixels = static_cast<uint8_t>(dv*78/maxDv);
-            if (g_batteryChargePercent > 100)
-            {
-                g_batteryChargePercent = 100;
-                g_batteryChargePixels = 78;
-            }
-        }
-        else
+        UpdateBatteryCharge(voltage);
+
+        // Update the internal resistance estimate: R = (Vloaded - Vrest)/Iloaded.
+        // The output-off cycle is the only current step we make, so the estimate
+        // costs no charge time on top of it. Ignore too small currents, the estimate
+        // would be too rough.
+        if (g_loadedCurrent >= 100)
         {
-            g_batteryChargePercent = 0;
-            g_batteryChargePixels = 0;
+            int16_t dv = static_cast<int16_t>(g_loadedVoltage - voltage);
+            if (dv > 0)
+                SetBatteryResistance(static_cast<uint16_t>(static_cast<uint32_t>(dv)*1000/g_loadedCurrent));
+            else
+                g_batteryResistance = 0;
         }
 
+        g_loadedCurrent = 0;
+        g_cyclesSinceMeasuring = 0;
+
         // If we're in the CCC mode and we've reached our target voltage, stop the charge
         if ((g_profile.m_options & COPT_CCC_MODE) && voltage >= g_profile.m_chargeVoltageX1000)
             return FinishCharge();
@@ -366,11 +443,30 @@ EState StateMachine(EState state, uint16_t voltage, uint16_t current)
         // Once in 10 seconds check whether we've charged the battery and measure the battery voltage
         if (ticksInState >= 1000)
         {
-            g_outOn = false;
-            if ((g_profile.m_options & COPT_CCC_MODE) || !g_chargeCanBeFinished)
-                return EState::MEASURING_VOLTAGE | EState::DONT_ERASE_BACKGROUND;
+            // The CCC mode needs the real battery voltage to finish the charge
+            if (!(g_profile.m_options & COPT_CCC_MODE))
+            {
+                if (g_chargeCanBeFinished)
+                {
+                    g_outOn = false;
+                    return FinishCharge();
+                }
+
+                // Estimate the resting battery voltage without switching the output off:
+                // Vrest = Vloaded - Iloaded*R
+                if (g_batteryResistance && ++g_cyclesSinceMeasuring < OFF_CYCLE_PERIOD)
+                {
+                    uint32_t drop = static_cast<uint32_t>(current)*g_batteryResistance/1000;
+                    UpdateBatteryCharge(drop < voltage ? voltage - static_cast<uint16_t>(drop) : 0);
+                    g_chargeCanBeFinished = true;
+                    return EState::RESET_TICKS;
+                }
+            }
 
-            return FinishCharge();            
+            g_loadedVoltage = voltage;
+            g_loadedCurrent = current;
+            g_outOn = false;
+            return EState::MEASURING_VOLTAGE | EState::DONT_ERASE_BACKGROUND;
         }
 
         // If the charge current exceeds the threshold value at least once in 10 seconds,
@@ -407,6 +503,7 @@ EState StateMachine(EState state, uint16_t voltage, uint16_t current)
                 return EState::DO_NOTHING;
         }
 
+        charge_log::FinishSession(SESSION_INTERRUPTED, g_batteryResistance);
         SetNoBatteryOuputValues();
         sound::PlayMusic(g_settings.m_chargeInterruptedMusic);
         return EState::NO_BATTERY;
@@ -501,26 +598,21 @@ void DrawBattery (int8_t chargeBarPos)
     display::SetColor(CLR_WHITE);
     display::SetSans12();
     utils::PercentToString(g_batteryChargePercent);
-    display::PrintStringRam(102, 106, g_buffer, 4);
-
-    cli();
-    uint16_t tempBattery = g_temperatureBattery;
-    sei();
+    display::PrintStringRamDiff(WG_CHARGE_PERCENT, 102, 106, g_buffer, 4, 0);
 
+    uint16_t tempBattery = utils::ReadU16(g_temperatureBattery);
     display::SetColor(utils::GetBatteryTempColor(tempBattery));
     utils::TemperatureToString(utils::TemperatureToDisplayX100(tempBattery));
-    display::PrintStringRam(174, 106, g_buffer + 1, 5);
+    display::PrintStringRamDiff(WG_TEMP_BATTERY, 174, 106, g_buffer + 1, 5, 0);
 };
 
 void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
 {
     g_ticksInState += static_cast<uint16_t>(ticksElapsed);
 
-    cli();
-    uint16_t voltage = g_adcVoltageAverage;
-    uint16_t current = g_adcCurrentAverage;
-    int16_t tempBoard = g_temperatureBoard;
-    sei();
+    uint16_t voltage, current;
+    utils::GetAdcAverages(voltage, current);
+    int16_t tempBoard = utils::ReadU16(g_temperatureBoard);
 
     voltage = g_settings.AdcVoltageToDisplayX1000(voltage);
     current = g_settings.AdcCurrentToDisplayX1000(current);
@@ -540,8 +632,14 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
         g_ticksInState = 0;
     }
 
+    if (state == EState::MEASURING_VOLTAGE || state == EState::CHARGING)
+        charge_log::UpdateSession();
+
     display::SetBgColor(CLR_BLACK);
 
+    // The state texts are drawn only once
+    bool drawStateObjects = display::IsWidgetChanged(WG_STATE_OBJECTS, 0, static_cast<uint8_t>(state), 0, 0);
+
     if (state == EState::NO_BATTERY)
     {
         static const uint8_t pm_noBatteryObjects[] PROGMEM =
@@ -553,7 +651,8 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
             DRO_STR(39, 170, S, "to start charging", 17),
             DRO_END
         };
-        display::DrawObjects(pm_noBatteryObjects, CLR_BLACK, CLR_WHITE);
+        if (drawStateObjects)
+            display::DrawObjects(pm_noBatteryObjects, CLR_BLACK, CLR_WHITE);
     }
 
     else if (state == EState::INVALID_BATTERY || state == EState::INVALID_BATTERY2)
@@ -569,11 +668,13 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
 
         voltage = SmoothValue(voltage, g_smoothVoltageValue, g_smoothVoltageTrend);
 
-        display::DrawObjects(pm_invalidBatteryObjects, CLR_BLACK, RGB(255, 153, 54));
+        if (drawStateObjects)
+            display::DrawObjects(pm_invalidBatteryObjects, CLR_BLACK, RGB(255, 153, 54));
+
         display::SetColor(RGB(255, 153, 54));
         display::SetSans18();
         utils::VoltageToString(voltage, true);
-        display::PrintStringRam(68, 176, g_buffer, 6);
+        display::PrintStringRamDiff(WG_VOLTAGE, 68, 176, g_buffer, 6, 0);
     }
 
     else if (state == EState::MEASURING_VOLTAGE || state == EState::CHARGING)
@@ -582,27 +683,42 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
 
         if (state == EState::CHARGING && g_ticksInState >= 20)
         {
-            voltage = SmoothValue(voltage, g_smoothVoltageValue, g_smoothVoltageTrend);
-            current = SmoothValue(current, g_smoothCurrentValue, g_smoothCurrentTrend);
+            // The state machine works on the averages, the display uses the filtered
+            // high resolution values
+            utils::GetAdcDisplayValues(voltage, current);
+            voltage = SmoothValue(g_settings.HiResVoltageToDisplayX1000(voltage),
+                g_smoothVoltageValue, g_smoothVoltageTrend);
+            current = SmoothValue(g_settings.HiResCurrentToDisplayX1000(current),
+                g_smoothCurrentValue, g_smoothCurrentTrend);
 
             display::SetSans18();
             display::SetColor(CLR_VOLTAGE);
             utils::VoltageToString(voltage, true);
-            display::PrintStringRam(10, 150, g_buffer, 6);
+            display::PrintStringRamDiff(WG_VOLTAGE, 10, 150, g_buffer, 6, 0);
 
             // Width = 19*3 + 9 + 23 = 89 px
             display::SetColor(CLR_CURRENT);
             utils::CurrentToString(current);
-            display::PrintStringRam(141, 150, g_buffer, 5);
+            display::PrintStringRamDiff(WG_CURRENT, 141, 150, g_buffer, 5, 0);
 
+            // Wattage and the battery internal resistance (if measured) alternate every 2 seconds
             display::SetSans12();
+            if (g_batteryResistance && (g_time[1] & 0x02))
+            {
+                display::SetColor(CLR_GRAY);
+                utils::ResistanceToString(g_batteryResistance, g_batteryResistanceTrend);
+            }
+            else
+            {
+                display::SetColor(CLR_WHITE);
+                utils::WattageToString(voltage, current);
+            }
+            display::PrintStringRamDiff(WG_WATTAGE, 10, 177, g_buffer, 6, 120);
             display::SetColor(CLR_WHITE);
-            utils::WattageToString(voltage, current);
-            display::PrintStringRam(10, 177, g_buffer, 6);
 
-            // Width = 13*5 + 6 + 16 + 13 = 100 px
-            utils::CapacityToString();
-            display::PrintStringRam(130, 177, g_buffer, 8);
+            // Width = 13*5 + 6 + 16 + 13 = 100 px (106 px for Wh)
+            utils::CapacityOrEnergyToString();
+            display::PrintStringRamDiff(WG_CAPACITY, 130, 177, g_buffer, 8, 238);
         }
     }
 
@@ -611,12 +727,13 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
         DrawBattery(100);
         static const char pm_chargeComplete[] PROGMEM = "Charge complete";
         display::SetColor(CLR_GRAY);
-        display::PrintString(32, 141, pm_chargeComplete);
+        if (drawStateObjects)
+            display::PrintString(32, 141, pm_chargeComplete);
 
         display::SetColor(RGB(128, 255, 0));
         display::SetSans18();
-        utils::CapacityToString();
-        display::PrintStringRam(47, 176, g_buffer, 8);
+        utils::CapacityOrEnergyToString();
+        display::PrintStringRamDiff(WG_CAPACITY, 47, 176, g_buffer, 8, 238);
     }
 
     else if (state == EState::BATTERY_ERROR)
@@ -630,28 +747,27 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
             DRO_STR(10, 173, S, "T:", 2),
             DRO_END
         };
-        display::DrawObjects(pm_batteryErrorObjects, CLR_BLACK, RGB(255, 153, 54));
-
-        cli();
-        uint16_t tempBattery = g_temperatureBattery;
-        sei();
+        if (drawStateObjects)
+            display::DrawObjects(pm_batteryErrorObjects, CLR_BLACK, RGB(255, 153, 54));
 
+        uint16_t tempBattery = utils::ReadU16(g_temperatureBattery);
         display::SetColor(utils::GetBatteryTempColor(tempBattery));
         utils::TemperatureToString(utils::TemperatureToDisplayX100(tempBattery));
-        display::PrintStringRam(10 + 15 + 6 + 6, 173, g_buffer + 1, 5);
+        display::PrintStringRamDiff(WG_TEMP_BATTERY, 10 + 15 + 6 + 6, 173, g_buffer + 1, 5, 0);
 
         display::SetColor(CLR_WHITE);
-        utils::CapacityToString();
-        display::PrintStringRam(130, 173, g_buffer, 8);
+        utils::CapacityOrEnergyToString();
+        display::PrintStringRamDiff(WG_CAPACITY, 130, 173, g_buffer, 8, 238);
 
         voltage = SmoothValue(voltage, g_smoothVoltageValue, g_smoothVoltageTrend);
         display::SetColor(CLR_VOLTAGE);
         utils::VoltageToString(voltage, true);
-        display::PrintStringRam(10 + 15 + 6 + 6, 145, g_buffer, 6);
+        display::PrintStringRamDiff(WG_VOLTAGE, 10 + 15 + 6 + 6, 145, g_buffer, 6, 0);
 
         display::SetUiElementColors(cursorPosition, UI_BATTERY_ERROR_CONTINUE);
         static const char pm_continue[] PROGMEM = "Continue";
-        display::PrintString(137, 145, pm_continue);
+        if (display::IsWidgetChanged(WG_CONTINUE, 0, 0, display::g_fgColor, display::g_bgColor))
+            display::PrintString(137, 145, pm_continue);
     }
 
     // Board temperature
@@ -659,64 +775,73 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
     display::SetColors(CLR_BLACK, utils::GetBoardTempColor(tempBoard));
     utils::TemperatureToString(utils::TemperatureToDisplayX100(tempBoard));
     g_buffer[0] = TEMP_BOARD_SYMBOL;
-    display::PrintStringRam(10, 203, g_buffer, 6);
+    display::PrintStringRamDiff(WG_TEMP_BOARD, 10, 203, g_buffer, 6, 0);
 
     // Battery error flag
-    if (state == EState::BATTERY_ERROR && (g_profile.m_options & COPT_MAKITA_PROTOCOL) &&
-        (!(PINB & BV(PB_IN_BATTERY_STATUS))))
+    bool batteryError = (state == EState::BATTERY_ERROR && (g_profile.m_options & COPT_MAKITA_PROTOCOL) &&
+        (!(PINB & BV(PB_IN_BATTERY_STATUS))));
+    if (display::IsWidgetChanged(WG_ERROR_FLAG, 0, batteryError, 0, 0))
     {
-        display::SetColor(CLR_RED_BEAUTIFUL);
-        static const char pm_fail[] PROGMEM = "Err"; // 15 + 8 + 8 = 31
-        display::PrintString(99, 203, pm_fail);
-    }
-    else
-    {
-        display::FillRect(99, 203 - 21, 31, 27, CLR_BLACK);
+        if (batteryError)
+        {
+            display::SetColor(CLR_RED_BEAUTIFUL);
+            static const char pm_fail[] PROGMEM = "Err"; // 15 + 8 + 8 = 31
+            display::PrintString(99, 203, pm_fail);
+        }
+        else
+        {
+            display::FillRect(99, 203 - 21, 31, 27, CLR_BLACK);
+        }
     }
 
     // Time
     // Width = 13*6 + 6*2 = 90 px
     display::SetColor(CLR_WHITE);
     utils::TimeToString();
-    display::PrintStringRam(140, 203, g_buffer, 8);
+    display::PrintStringRamDiff(WG_TIME, 140, 203, g_buffer, 8, 0);
 
     // Set current
     utils::CurrentToString(g_profile.m_chargeCurrentX1000);
-    display::DrawSettableDecimal(17, CurrentYPos, 4, cursorPosition - UI_CURRENT1, CLR_WHITE, CLR_DARK_BLUE);
+    display::DrawWidgetSettableDecimal(WG_SET_CURRENT, 17, CurrentYPos, 4, cursorPosition - UI_CURRENT1, CLR_WHITE, CLR_DARK_BLUE);
 
     // Charge mode
     display::SetBgColor(cursorPosition == UI_CCCMODE ? CLR_BG_CURSOR : CLR_DARK_BLUE);
-    if (g_profile.m_options & COPT_CCC_MODE)
+    uint8_t cccMode = g_profile.m_options & COPT_CCC_MODE;
+    if (display::IsWidgetChanged(WG_CHARGE_MODE, 0, cccMode, display::g_fgColor, display::g_bgColor))
     {
-        // Width = 17*3 = 51 px
-        static const char pm_cccMode[] PROGMEM = "CCC";
-        static const display::Rect pm_cccRects[] PROGMEM =
+        if (cccMode)
         {
-            {10, ChargeModeYPos - 21, 11, 27},
-            {10 + 11 + 51, ChargeModeYPos - 21, 11, 27},
-        };
-        display::FillRects(pm_cccRects, 2, display::g_bgColor);
-        display::PrintString(10 + 11, ChargeModeYPos, pm_cccMode);
-    }
-    else
-    {
-        // Width = 17*3 + 7 + 15 = 73 px
-        static const char pm_cccvMode[] PROGMEM = "CC/CV";
-        display::PrintString(10, ChargeModeYPos, pm_cccvMode);
+            // Width = 17*3 = 51 px
+            static const char pm_cccMode[] PROGMEM = "CCC";
+            static const display::Rect pm_cccRects[] PROGMEM =
+            {
+                {10, ChargeModeYPos - 21, 11, 27},
+                {10 + 11 + 51, ChargeModeYPos - 21, 11, 27},
+            };
+            display::FillRects(pm_cccRects, 2, display::g_bgColor);
+            display::PrintString(10 + 11, ChargeModeYPos, pm_cccMode);
+        }
+        else
+        {
+            // Width = 17*3 + 7 + 15 = 73 px
+            static const char pm_cccvMode[] PROGMEM = "CC/CV";
+            display::PrintString(10, ChargeModeYPos, pm_cccvMode);
+        }
     }
 
-    const auto DrawOption = [&](uint8_t x, uint8_t option, uint8_t uiPosition, const char* text)
+    const auto DrawOption = [&](uint8_t widget, uint8_t x, uint8_t option, uint8_t uiPosition, const char* text)
     {
         display::SetBgColor(cursorPosition == uiPosition ? CLR_BG_CURSOR : CLR_DARK_BLUE);
         display::SetColor((g_profile.m_options & option) ? CLR_WHITE : RGB(192, 0, 0));
-        display::PrintString(x, ChargeOptionsYPos, text);
+        if (display::IsWidgetChanged(widget, 0, 0, display::g_fgColor, display::g_bgColor))
+            display::PrintString(x, ChargeOptionsYPos, text);
     };
 
     // Options
     static const char pm_opt3Pin[] PROGMEM = "Mk";
     static const char pm_optRestart[] PROGMEM = "Rst";
-    DrawOption(10, COPT_MAKITA_PROTOCOL, UI_OPT_MAKITA_PROTO, pm_opt3Pin);
-    DrawOption(50, COPT_RESTART_CHARGE, UI_OPT_CHARGE_RESTART, pm_optRestart);
+    DrawOption(WG_OPT_MAKITA_PROTO, 10, COPT_MAKITA_PROTOCOL, UI_OPT_MAKITA_PROTO, pm_opt3Pin);
+    DrawOption(WG_OPT_CHARGE_RESTART, 50, COPT_RESTART_CHARGE, UI_OPT_CHARGE_RESTART, pm_optRestart);
 
     g_batteryChargeBarPosition += static_cast<int16_t>(ticksElapsed) << 5;
     int8_t* chargeBarPos = reinterpret_cast<int8_t*>(&g_batteryChargeBarPosition) + 1;
@@ -808,6 +933,8 @@ bool OnLongClick(int8_t cursorPosition)
 
             return false;
         }
+
+        charge_log::FinishSession(SESSION_STOPPED, g_batteryResistance);
     }
 
     uint8_t result = pm_chargerMenu.Show();
@@ -52,6 +52,18 @@ var uint16_t g_previousBatteryVoltage;
 var uint8_t g_noBatteryDetectCount;
 var bool g_chargeCanBeFinished;
 
+// Battery internal resistance estimate in mOhm (0 - not measured yet), the loaded
+// voltage and current measured right before the last output-off cycle and the
+// number of charge cycles since then. Used internally by StateMachine()
+var uint16_t g_batteryResistance;
+var uint16_t g_loadedVoltage;
+var uint16_t g_loadedCurrent;
+var uint8_t g_cyclesSinceMeasuring;
+
+// Internal resistance trend: 1 - rising, -1 - falling, 0 - stable.
+// Set in SetBatteryResistance(), used by DrawElements()
+var int8_t g_batteryResistanceTrend;
+
 // Set in StateMachine(), used by DrawBattery()
 var uint8_t g_batteryChargePercent;
 var uint8_t g_batteryChargePixels;
@@ -6,7 +6,7 @@ using screen::settings::g_previousCursorPosition;
 using ::charger::g_editorProfile;
 using ::charger::g_tempProfile;
 
-#define UI_ELEMENT_COUNT (20 + (4 + 3 + 4 + 2) + (4 + 4 + 3) + 3)
+#define UI_ELEMENT_COUNT (20 + (4 + 3 + 4 + 2) + (4 + 4 + 3) + 3 + 2)
 #define UI_PROFILE_NAME 0
 #define UI_VOLTAGE 20
 #define UI_CURRENT 24
@@ -18,6 +18,8 @@ using ::charger::g_tempProfile;
 #define UI_OPT_CCC 44
 #define UI_OPT_3RD_PIN 45
 #define UI_OPT_RESTART 46
+#define UI_PID_KP 47
+#define UI_PID_KI 48
 
 constexpr uint8_t XPage = 240 - 7 - 13*2 - 7;
 
@@ -116,7 +118,7 @@ int8_t DrawBackgroundP1()
     {
         DRO_FILLRECT | 1, 0, 0, 240, 30,
         DRO_STR(26, YHeader, S, "Charger profile", 15),
-        DRO_STR(XPage, YHeader, S, "1/3", 3),
+        DRO_STR(XPage, YHeader, S, "1/4", 3),
 
         DRO_BGCOLOR(CLR_DARK_BLUE),
         DRO_FILLRECT | 1, 0, 30, 240, 30,
@@ -149,7 +151,7 @@ void DrawBackgroundP2()
     {
         DRO_FILLRECT | 1, 0, 0, 240, 30,
         DRO_STR(26, YHeader, S, "Charger profile", 15),
-        DRO_STR(XPage, YHeader, S, "2/3", 3),
+        DRO_STR(XPage, YHeader, S, "2/4", 3),
 
         DRO_BGCOLOR(CLR_DARK_BLUE),
         DRO_FILLRECT | 1, 0, 30, 240, 30,
@@ -178,7 +180,7 @@ void DrawBackgroundP3()
     {
         DRO_FILLRECT | 1, 0, 0, 240, 30,
         DRO_STR(26, YHeader, S, "Charger profile", 15),
-        DRO_STR(XPage, YHeader, S, "3/3", 3),
+        DRO_STR(XPage, YHeader, S, "3/4", 3),
 
         DRO_BGCOLOR(CLR_DARK_BLUE),
         DRO_FILLRECT | 1, 0, 30, 240, 30,
@@ -197,14 +199,40 @@ void DrawBackgroundP3()
     display::DrawObjects(pm_bgObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
 }
 
+void DrawBackgroundP4()
+{
+    static const uint8_t pm_bgObjects[] PROGMEM =
+    {
+        DRO_FILLRECT | 1, 0, 0, 240, 30,
+        DRO_STR(26, YHeader, S, "Charger profile", 15),
+        DRO_STR(XPage, YHeader, S, "4/4", 3),
+
+        DRO_BGCOLOR(CLR_DARK_BLUE),
+        DRO_FILLRECT | 1, 0, 30, 240, 30,
+
+        DRO_BGCOLOR(CLR_BLACK),
+        DRO_FILLRECT | 1, 0, 60, 240, 180,
+
+        DRO_FGCOLOR(CLR_GRAY),
+        DRO_STR(7, YLine1, S, "PID proportional gain", 21),
+        DRO_STR(7, YLine3, S, "PID integral gain", 17),
+        DRO_STR(7, YLine5, S, "(in 1/128 units)", 16),
+
+        DRO_END
+    };
+    display::DrawObjects(pm_bgObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
+}
+
 void DrawPageBackground(uint8_t nPage)
 {
     if (!nPage)
         DrawBackgroundP1();
     else if (nPage == 1)
         DrawBackgroundP2();
-    else
+    else if (nPage == 2)
         DrawBackgroundP3();
+    else
+        DrawBackgroundP4();
 }
 
 uint8_t GetPageNumber(int8_t cursorPosition)
@@ -212,6 +240,9 @@ uint8_t GetPageNumber(int8_t cursorPosition)
     if (cursorPosition < UI_RESTART_VOLTAGE)
         return 0;
 
+    if (cursorPosition >= UI_PID_KP)
+        return 3;
+
     if (cursorPosition >= UI_OPT_CCC)
         return 2;
 
@@ -282,11 +313,21 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
         display::DrawSettableDecimal(240 - 7 - 13*3 - 19 - 16, YLine6, 3,
             cursorPosition - UI_OPEN_CURRENT, CLR_WHITE, CLR_BLACK);
     }
-    else
+    else if (nPage == 2)
     {
         for (const SBitOption& option: pm_options)
             option.Draw(cursorPosition);
     }
+    else
+    {
+        display::SetUiElementColors(cursorPosition, UI_PID_KP);
+        utils::I8ToStringSpaces(g_editorProfile.m_pidKp);
+        display::PrintStringRam(240 - 7 - 13*3, YLine2, g_buffer, 3);
+
+        display::SetUiElementColors(cursorPosition, UI_PID_KI);
+        utils::I8ToStringSpaces(g_editorProfile.m_pidKi);
+        display::PrintStringRam(240 - 7 - 13*3, YLine4, g_buffer, 3);
+    }
 }
 
 bool OnClick(int8_t cursorPosition)
@@ -373,6 +414,18 @@ void OnChangeValue(int8_t cursorPosition, int8_t delta)
             UI_OPEN_CURRENT + 2 - cursorPosition, delta, 10, 900);
         return;
     }
+
+    if (cursorPosition == UI_PID_KP)
+    {
+        g_editorProfile.m_pidKp = utils::ChangeI8ByDelta(g_editorProfile.m_pidKp, delta, 1, 255);
+        return;
+    }
+
+    if (cursorPosition == UI_PID_KI)
+    {
+        g_editorProfile.m_pidKi = utils::ChangeI8ByDelta(g_editorProfile.m_pidKi, delta, 1, 255);
+        return;
+    }
 }
 
 bool OnLongClick(int8_t cursorPosition)
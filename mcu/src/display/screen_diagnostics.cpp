@@ -0,0 +1,261 @@
+#include "../includes.h"
+
+#ifdef DIAGNOSTICS
+
+namespace screen::diagnostics {
+
+#define UI_RESET 0
+#define UI_BENCHMARK 1
+#define UI_ELEMENT_COUNT 2
+
+constexpr uint8_t YHeader = 23;
+constexpr uint8_t YTableHeader = 50;
+constexpr uint8_t YFirstLine = 74;
+constexpr uint8_t YLineStep = 22;
+constexpr uint8_t YReset = 232;
+
+constexpr uint8_t XAverage = 240 - 7 - 13*5 - 13 - 13*5;
+constexpr uint8_t XMax = 240 - 7 - 13*5;
+
+// Path budgets in CPU clocks. ADC paths must leave at least half of the 256-clock
+// timer slot to the main code (overrunning the whole slot is reported as a failure,
+// see ProcessFailureStates()). The eighth interrupt paths run with interrupts enabled
+// and must be finished well before the next eighth interrupt (8*256 clocks), otherwise
+// the PID will miss PWM updates.
+static const uint16_t pm_budgets[DIAG_PATH_COUNT] PROGMEM =
+{
+    128,        // DIAG_PATH_ADC_NORMAL
+    128,        // DIAG_PATH_ADC_EARLY
+    1024,       // DIAG_PATH_8TH
+    1024,       // DIAG_PATH_AVERAGER
+    7*256,      // DIAG_PATH_100HZ
+};
+
+// The ADC start time budget: the normal start is at about 50 clocks from the overflow
+// with the minimal interrupt response. Every clock above that is spent by the main code
+// with interrupts disabled and delays the sampling point.
+constexpr uint8_t AdcStartBudget = 64;
+
+int8_t DrawBackground()
+{
+    static const uint8_t pm_bgObjects[] PROGMEM =
+    {
+        DRO_FILLRECT | 1, 0, 0, 240, 30,
+        DRO_STR(45, YHeader, S, "DIAGNOSTICS", 11),
+
+        DRO_BGCOLOR(CLR_BLACK),
+        DRO_FILLRECT | 1, 0, 30, 240, 210,
+
+        DRO_FGCOLOR(CLR_GRAY),
+        DRO_STR(7, YTableHeader, S, "ISR path", 8),
+        DRO_STR(XAverage + 13, YTableHeader, S, "Avg", 3),
+        DRO_STR(XMax + 13, YTableHeader, S, "Max", 3),
+
+        DRO_FGCOLOR(CLR_WHITE),
+        DRO_STR(7, YFirstLine, S, "ADC", 3),
+        DRO_STR(7, YFirstLine + YLineStep, S, "ADC early", 9),
+        DRO_STR(7, YFirstLine + YLineStep*2, S, "PID", 3),
+        DRO_STR(7, YFirstLine + YLineStep*3, S, "Averager", 8),
+        DRO_STR(7, YFirstLine + YLineStep*4, S, "100 Hz", 6),
+        DRO_STR(7, YFirstLine + YLineStep*5, S, "ADC start", 9),
+        DRO_STR(7, YFirstLine + YLineStep*6, S, "Px/frame", 8),
+        DRO_END
+    };
+    display::DrawObjects(pm_bgObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
+
+    // Pixels sent to the display per DrawElements() call since the diagnostics screen was left,
+    // i.e. by the other screens
+    uint16_t frames = display::g_frameCounter - g_frameCounterMark;
+    uint32_t pixels = frames ? (display::g_pixelsPushed - g_pixelsPushedMark)/frames : 0;
+    g_averageFramePixels = pixels > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(pixels);
+
+    return UI_RESET;
+}
+
+void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
+{
+    display::SetSans12();
+
+    // Reset and benchmark buttons
+    static const char pm_reset[] PROGMEM = "Reset max";
+    display::SetUiElementColors(cursorPosition, UI_RESET);
+    display::PrintString(7, YReset, pm_reset);
+
+    static const char pm_benchmark[] PROGMEM = "Benchmark";
+    display::SetUiElementColors(cursorPosition, UI_BENCHMARK);
+    display::PrintString(240 - 7 - display::GetTextWidth(pm_benchmark), YReset, pm_benchmark);
+
+    // Update statistics twice per second
+    static uint8_t ticks = 0;
+    ticks += ticksElapsed;
+    if (ticks < 50)
+        return;
+
+    ticks = 0;
+    for (uint8_t i = 0; i < DIAG_PATH_COUNT; ++i)
+    {
+        // Take the averages and start a new measurement period
+        cli();
+        SIsrPathStats stats = g_isrStats[i];
+        g_isrStats[i].m_count = 0;
+        g_isrStats[i].m_sum = 0;
+        sei();
+
+        uint8_t y = YFirstLine + YLineStep*i;
+        uint16_t average = stats.m_count ? static_cast<uint16_t>(stats.m_sum/stats.m_count) : 0;
+        display::SetColors(CLR_BLACK, CLR_WHITE);
+        utils::I16ToString(average, g_buffer, 4);
+        display::PrintStringRam(XAverage, y, g_buffer, 5);
+
+        // Show the worst-case value in red if it exceeds the budget
+        display::SetColor(stats.m_max > pgm_read_word(&pm_budgets[i]) ? CLR_RED : CLR_GREEN);
+        utils::I16ToString(stats.m_max, g_buffer, 4);
+        display::PrintStringRam(XMax, y, g_buffer, 5);
+    }
+
+    // The ADC start time, the maximum only
+    uint8_t y = YFirstLine + YLineStep*DIAG_PATH_COUNT;
+    uint8_t adcStartMax = g_diagAdcStartMax;
+    display::SetColors(CLR_BLACK, adcStartMax > AdcStartBudget ? CLR_RED : CLR_GREEN);
+    utils::I16ToString(adcStartMax, g_buffer, 4);
+    display::PrintStringRam(XMax, y, g_buffer, 5);
+
+    y += YLineStep;
+    uint32_t maxPixels = display::g_maxFramePixels;
+    display::SetColor(CLR_WHITE);
+    utils::I16ToString(g_averageFramePixels, g_buffer, 4);
+    display::PrintStringRam(XAverage, y, g_buffer, 5);
+    utils::I16ToString(maxPixels > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(maxPixels), g_buffer, 4);
+    display::PrintStringRam(XMax, y, g_buffer, 5);
+}
+
+void MarkDisplayCounters()
+{
+    g_frameCounterMark = display::g_frameCounter;
+    g_pixelsPushedMark = display::g_pixelsPushed;
+}
+
+// Calls func count times and returns the display throughput in thousands of pixels per second.
+// The time is measured by the 100 Hz timer and includes the command overhead and the time
+// taken by the interrupts, i.e. it's the real throughput the screens get.
+uint16_t MeasureThroughput(void (*func)(uint8_t n), uint8_t count)
+{
+    // Start right at a timer tick
+    uint8_t tick = g_100HzCounter;
+    while (g_100HzCounter == tick);
+
+    tick = g_100HzCounter;
+    uint32_t pixels = display::g_pixelsPushed;
+    for (uint8_t i = 0; i < count; ++i)
+        func(i);
+
+    uint8_t ticks = g_100HzCounter - tick;
+    pixels = display::g_pixelsPushed - pixels;
+
+    // Pixels per 10 ms tick to kpx/s
+    return ticks ? static_cast<uint16_t>(pixels/ticks/10) : 0;
+}
+
+void RunBenchmark()
+{
+    // The benchmark must not count in the pixels per frame statistics
+    uint32_t pixelsPushed = display::g_pixelsPushed;
+
+    // Full screen fills, 8 * 57600 pixels (about 1 s)
+    uint16_t clearSpeed = MeasureThroughput([](uint8_t n)
+    {
+        display::Clear((n & 1) ? CLR_DARK_BLUE : CLR_BLACK);
+    }, 8);
+
+    // Sans18 digits (19x36 pixels each), 100 * 8 glyphs (about 1.2 s)
+    uint16_t glyphSpeed = MeasureThroughput([](uint8_t n)
+    {
+        static const char pm_digits[] PROGMEM = "88888888";
+        display::SetColors(CLR_BLACK, (n & 1) ? CLR_WHITE : CLR_GRAY);
+        display::PrintString(44, 130, pm_digits);
+    }, 100);
+
+    static const uint8_t pm_resultObjects[] PROGMEM =
+    {
+        DRO_FILLRECT | 1, 0, 0, 240, 30,
+        DRO_STR(43, YHeader, S, "BENCHMARK", 9),
+
+        DRO_BGCOLOR(CLR_BLACK),
+        DRO_FILLRECT | 1, 0, 30, 240, 210,
+
+        DRO_FGCOLOR(CLR_GRAY),
+        DRO_STR(7, YTableHeader, S, "Throughput", 10),
+        DRO_STR(XMax + 13, YTableHeader, S, "kpx/s", 5),
+
+        DRO_FGCOLOR(CLR_WHITE),
+        DRO_STR(7, YFirstLine, S, "Clear", 5),
+        DRO_STR(7, YFirstLine + YLineStep, S, "Sans18 glyphs", 13),
+        DRO_END
+    };
+    display::DrawObjects(pm_resultObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
+
+    display::SetSans12();
+    display::SetColors(CLR_BLACK, CLR_GREEN);
+    utils::I16ToString(clearSpeed, g_buffer, 4);
+    display::PrintStringRam(XMax, YFirstLine, g_buffer, 5);
+    utils::I16ToString(glyphSpeed, g_buffer, 4);
+    display::PrintStringRam(XMax, YFirstLine + YLineStep, g_buffer, 5);
+
+    static const char pm_ok[] PROGMEM = "OK";
+    display::SetColors(CLR_BG_CURSOR, CLR_WHITE);
+    display::PrintString((240 - display::GetTextWidth(pm_ok))/2, YReset, pm_ok);
+
+    display::g_pixelsPushed = pixelsPushed;
+
+    utils::ClearPendingKeys();
+    while (utils::GetEncoderKey() != EEncoderKey::Up);
+}
+
+bool OnClick(int8_t cursorPosition)
+{
+    if (cursorPosition == UI_BENCHMARK)
+    {
+        RunBenchmark();
+        DrawBackground();
+        return false;
+    }
+
+    cli();
+    for (SIsrPathStats& stats: g_isrStats)
+        stats.m_max = 0;
+    sei();
+    g_diagAdcStartMax = 0;
+
+    display::g_maxFramePixels = 0;
+    MarkDisplayCounters();
+    return false;
+}
+
+void OnChangeValue(int8_t cursorPosition, int8_t delta)
+{
+}
+
+bool OnLongClick(int8_t cursorPosition)
+{
+    MarkDisplayCounters();
+    return true;
+}
+
+static const display::UiScreen pm_diagnosticsScreen PROGMEM =
+{
+    UI_ELEMENT_COUNT,
+    &DrawBackground,
+    &DrawElements,
+    &OnClick,
+    &OnChangeValue,
+    &OnLongClick
+};
+
+void Show()
+{
+    pm_diagnosticsScreen.Show();
+}
+
+} // namespace screen::diagnostics
+
+#endif // DIAGNOSTICS
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../data.h"
+
+namespace screen::diagnostics {
+
+#ifdef DIAGNOSTICS
+// Display counters when the diagnostics screen was left (or the maximums were reset) last time
+var uint16_t g_frameCounterMark;
+var uint32_t g_pixelsPushedMark;
+
+// Average pixels per frame since then, calculated when the screen is shown
+var uint16_t g_averageFramePixels;
+#endif
+
+void Show();
+
+} // namespace screen::diagnostics
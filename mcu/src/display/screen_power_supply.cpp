@@ -13,6 +13,21 @@ namespace screen::psupply {
 #define UI_CURRENT3 8
 #define UI_ELEMENT_COUNT 9
 
+// Cached widgets
+#define WG_CV 0
+#define WG_CC 1
+#define WG_OUT 2
+#define WG_VOLTAGE 3
+#define WG_CURRENT 4
+#define WG_WATTAGE 5
+#define WG_CAPACITY 6
+#define WG_TIME 7
+#define WG_TEMP_BOARD 8
+#define WG_TEMP_BATTERY 9
+#define WG_FAN_SPEED 10
+#define WG_SET_VOLTAGE 11
+#define WG_SET_CURRENT 12
+
 // Power supply menu:
 //   Return
 //   Exit
@@ -120,13 +135,14 @@ int8_t DrawBackground()
         DRO_END
     };
     display::DrawObjects(pm_bgObject, CLR_RED_BEAUTIFUL, CLR_WHITE);
+    display::InvalidateWidgets();
 
     return 0;
 }
 
 void DrawMode(int8_t cursorPosition)
 {
-    const auto DrawObjects = [](const uint8_t* objects, bool active, bool cursor)
+    const auto DrawObjects = [](uint8_t widget, const uint8_t* objects, bool active, bool cursor)
     {
         uint16_t bgColor, fgColor;
         if (active)
@@ -143,7 +159,8 @@ void DrawMode(int8_t cursorPosition)
         if (cursor)
             bgColor = CLR_BG_CURSOR;
 
-        display::DrawObjects(objects, bgColor, fgColor);
+        if (display::IsWidgetChanged(widget, 0, 0, fgColor, bgColor))
+            display::DrawObjects(objects, bgColor, fgColor);
     };
 
     uint8_t pidMode = g_pidMode;
@@ -161,7 +178,7 @@ void DrawMode(int8_t cursorPosition)
             204, 36, 30, 36,
         DRO_END
     };
-    DrawObjects(pm_cvObjects, pidMode == PID_MODE_CV, false);
+    DrawObjects(WG_CV, pm_cvObjects, pidMode == PID_MODE_CV, false);
 
     // CC
     // Rect: (142, 74, 92, 36)
@@ -176,7 +193,7 @@ void DrawMode(int8_t cursorPosition)
             205, 74, 29, 36,
         DRO_END
     };
-    DrawObjects(pm_ccObjects, pidMode == PID_MODE_CC, false);
+    DrawObjects(WG_CC, pm_ccObjects, pidMode == PID_MODE_CC, false);
 
     // OUT
     // Rect: (142, 112, 92, 36)
@@ -191,84 +208,81 @@ void DrawMode(int8_t cursorPosition)
             214, 112, 20, 36,
         DRO_END
     };
-    DrawObjects(pm_outObjects, g_outOn, cursorPosition == UI_OUT);
+    DrawObjects(WG_OUT, pm_outObjects, g_outOn, cursorPosition == UI_OUT);
 }
 
 void DrawMeasurements(int8_t cursorPosition)
 {
-    cli();
-    uint16_t voltage = g_adcVoltageAverage;
-    uint16_t current = g_adcCurrentAverage;
-    sei();
+    uint16_t voltage, current;
+    utils::GetAdcDisplayValues(voltage, current);
 
     display::SetSans18();
 
     // Voltage
     display::SetColors(CLR_BLACK, CLR_VOLTAGE);
-    voltage = g_settings.AdcVoltageToDisplayX1000(voltage);
+    voltage = g_settings.HiResVoltageToDisplayX1000(voltage);
     utils::VoltageToString(voltage, true);
-    display::PrintStringRam(11, 36 + 5 + 25, g_buffer, 5);
+    display::PrintStringRamDiff(WG_VOLTAGE, 11, 36 + 5 + 25, g_buffer, 5, 0);
 
     // Current
     display::SetColor(CLR_CURRENT);
-    current = g_settings.AdcCurrentToDisplayX1000(current);
+    current = g_settings.HiResCurrentToDisplayX1000(current);
     utils::CurrentToString(current);
-    display::PrintStringRam(11 + 19, 74 + 5 + 25, g_buffer, 4);
+    display::PrintStringRamDiff(WG_CURRENT, 11 + 19, 74 + 5 + 25, g_buffer, 4, 0);
 
     // Wattage
     display::SetColor(CLR_WATTAGE);
     utils::WattageToString(voltage, current);
-    display::PrintStringRam(11, 112 + 5 + 25, g_buffer, 5);
+    display::PrintStringRamDiff(WG_WATTAGE, 11, 112 + 5 + 25, g_buffer, 5, 0);
 
-    // Capacity
+    // Capacity and energy
     constexpr uint8_t yCapacity = 158 + 19;
     display::SetSans12();
     display::SetColors(cursorPosition == UI_TIME_CAPACITY ? CLR_BG_CURSOR : CLR_BLACK, CLR_WHITE);
-    utils::CapacityToString();
-    uint8_t x = display::PrintStringRam(8, yCapacity, g_buffer, 8);
-    display::FillRect(x, yCapacity - 21, 141 - x, 27, display::g_bgColor);
+    utils::CapacityOrEnergyToString();
+    display::PrintStringRamDiff(WG_CAPACITY, 8, yCapacity, g_buffer, 8, 141);
 
     // Time
     utils::TimeToString();
-    display::PrintStringRam(141, yCapacity, g_buffer, 8);
+    display::PrintStringRamDiff(WG_TIME, 141, yCapacity, g_buffer, 8, 0);
 
     // Temperature
-    cli();
-    int16_t tempBoard = g_temperatureBoard;
-    int16_t tempBattery = g_temperatureBattery;
-    sei();
+    int16_t tempBoard = utils::ReadU16(g_temperatureBoard);
+    int16_t tempBattery = utils::ReadU16(g_temperatureBattery);
 
     display::SetColors(CLR_BLACK, utils::GetBoardTempColor(tempBoard));
     utils::TemperatureToString(utils::TemperatureToDisplayX100(tempBoard));
     g_buffer[0] = TEMP_BOARD_SYMBOL;
-    display::PrintStringRam(8, yCapacity + 27, g_buffer, 6);
+    display::PrintStringRamDiff(WG_TEMP_BOARD, 8, yCapacity + 27, g_buffer, 6, 0);
 
     display::SetColor(utils::GetBatteryTempColor(tempBattery));
     utils::TemperatureToString(utils::TemperatureToDisplayX100(tempBattery));
     g_buffer[0] = TEMP_BATTERY_SYMBOL;
-    display::PrintStringRam(93, yCapacity + 27, g_buffer, 6);
+    display::PrintStringRamDiff(WG_TEMP_BATTERY, 93, yCapacity + 27, g_buffer, 6, 0);
 
     // Fan speed
     display::SetColor(CLR_WHITE);
     utils::FanSpeedToString();
-    display::PrintStringRam(174, yCapacity + 27, g_buffer, 4);
+    display::PrintStringRamDiff(WG_FAN_SPEED, 174, yCapacity + 27, g_buffer, 4, 0);
 }
 
 void DrawSettables(int8_t cursorPosition)
 {
     uint8_t nSelected = cursorPosition - UI_VOLTAGE1;
     utils::VoltageToString(g_settings.m_psSettings.m_voltage, nSelected != 0);
-    display::DrawSettableDecimal(71, 214 + 19, 5, nSelected, CLR_WHITE, CLR_BLUE);
+    display::DrawWidgetSettableDecimal(WG_SET_VOLTAGE, 71, 214 + 19, 5, nSelected, CLR_WHITE, CLR_BLUE);
 
     utils::CurrentToString(g_settings.m_psSettings.m_current);
     nSelected = cursorPosition - UI_CURRENT1;
-    display::DrawSettableDecimal(156, 214 + 19, 4, nSelected, CLR_WHITE, CLR_BLUE);
+    display::DrawWidgetSettableDecimal(WG_SET_CURRENT, 156, 214 + 19, 4, nSelected, CLR_WHITE, CLR_BLUE);
 }
 
 void UpdateTargetValues()
 {
     g_pidTargetVoltage = g_settings.DisplayX1000VoltageToAdc(g_settings.m_psSettings.m_voltage);
     g_pidTargetCurrent = g_settings.DisplayX1000CurrentToAdc(g_settings.m_psSettings.m_current);
+    g_pidKp = DEFAULT_PID_KP;
+    g_pidKi = DEFAULT_PID_KI;
 }
 
 void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
@@ -289,7 +303,7 @@ bool OnClick(int8_t cursorPosition)
     if (cursorPosition == UI_TIME_CAPACITY)
     {
         static const char pm_timeResetTitle[] PROGMEM = "Time reset";
-        static const char pm_timeResetText[] PROGMEM = "Are you sure\nwant to reset\ntime and capacity\nvalues?";
+        static const char pm_timeResetText[] PROGMEM = "Are you sure\nwant to reset\ntime, capacity\nand energy?";
 
         if (display::MessageBox(pm_timeResetTitle, pm_timeResetText, MB_YESNO | MB_DEFAULT_NO) == 0)
             utils::TimeCapacityReset();
@@ -74,7 +74,8 @@ struct SValue
     static constexpr uint8_t X3Digits = 240 - 7 - 13*3;
     static constexpr uint8_t XPower = 240 - 7 - 13*3 - 22;
 
-    void Draw(int8_t cursorPosition) const
+    // Draws the value as the cached widget number 'widget' (see display::IsWidgetChanged())
+    void Draw(int8_t cursorPosition, uint8_t widget) const
     {
         display::SetUiElementColors(cursorPosition, pgm_read_byte(&m_uiPosition));
 
@@ -84,6 +85,9 @@ struct SValue
 
         if (type == SOUND)
         {
+            if (!display::IsWidgetChanged(widget, 0, value, display::g_fgColor, display::g_bgColor))
+                return;
+
             const char* text = reinterpret_cast<const char*>(pgm_read_word(&sound::pm_melodies[value].m_name));
             uint8_t width = display::GetTextWidth(text);
             display::FillRect(7, y - 21, 240 - 14 - width, 27, display::g_bgColor);
@@ -97,15 +101,15 @@ struct SValue
             uint16_t value16 = static_cast<uint16_t>(value)*151 >> 7;
             utils::I16ToString(value16, g_buffer, 4);
             g_buffer[5] = 'W';
-            display::PrintStringRam(XPower, y, g_buffer + 2, 4);
+            display::PrintStringRamDiff(widget, XPower, y, g_buffer + 2, 4, 0);
             return;
         }
 
         utils::I8ToStringSpaces(value);
         if (type == U8_2D)
-            display::PrintStringRam(X2Digits, y, g_buffer + 1, 2);
+            display::PrintStringRamDiff(widget, X2Digits, y, g_buffer + 1, 2, 0);
         else
-            display::PrintStringRam(X3Digits, y, g_buffer, 3);
+            display::PrintStringRamDiff(widget, X3Digits, y, g_buffer, 3, 0);
     }
 
     void Change(int8_t delta) const
@@ -163,6 +167,9 @@ static const SPageInfo pm_pages[] PROGMEM =
     {3, &DrawBackgroundPage3},
 };
 
+// The page values are the cached widgets numbered from 0 on every page
+static_assert(5 <= DISPLAY_WIDGET_COUNT, "Not enough widgets for a settings page");
+
 // ***
 
 int8_t DrawBackgroundPage0()
@@ -185,6 +192,7 @@ int8_t DrawBackgroundPage0()
         DRO_END
     };
     display::DrawObjects(pm_bgObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
+    display::InvalidateWidgets();
     return 0;
 }
 
@@ -204,6 +212,7 @@ int8_t DrawBackgroundPage1()
         DRO_END
     };
     display::DrawObjects(pm_bgObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
+    display::InvalidateWidgets();
     return 0;
 }
 
@@ -227,6 +236,7 @@ int8_t DrawBackgroundPage2()
         DRO_END
     };
     display::DrawObjects(pm_bgObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
+    display::InvalidateWidgets();
     return 0;
 }
 
@@ -247,6 +257,7 @@ int8_t DrawBackgroundPage3()
         DRO_END
     };
     display::DrawObjects(pm_bgObjects, CLR_RED_BEAUTIFUL, CLR_WHITE);
+    display::InvalidateWidgets();
     return 0;
 }
 
@@ -282,8 +293,8 @@ void DrawElements(int8_t cursorPosition, uint8_t ticksElapsed)
         }
 
         // Draw page elements
-        while(pageStart < nextPageStart)
-            pm_values[pageStart++].Draw(cursorPosition);
+        for (uint8_t widget = 0; pageStart < nextPageStart; ++widget)
+            pm_values[pageStart++].Draw(cursorPosition, widget);
 
         break;
     }
@@ -0,0 +1,87 @@
+#include "../includes.h"
+
+namespace eeprom {
+
+static uint8_t NextQueueIndex(uint8_t index)
+{
+    return index == EEPROM_QUEUE_SIZE - 1 ? 0 : index + 1;
+}
+
+void Write(uint16_t address, const void* data, uint16_t count)
+{
+    if (!count)
+        return;
+
+    // Wait for a free entry
+    uint8_t tail = g_eepromQueueTail;
+    uint8_t nextTail = NextQueueIndex(tail);
+    while (nextTail == g_eepromQueueHead);
+
+    // The interrupt doesn't touch the tail entry
+    SWrite& write = g_eepromQueue[tail];
+    write.m_data = static_cast<const uint8_t*>(data);
+    write.m_address = address;
+    write.m_count = count;
+    g_eepromQueueTail = nextTail;
+
+    // If the EEPROM is ready, the interrupt is requested right away
+    EECR |= BV(EERIE);
+}
+
+void WriteCopy(uint16_t address, const void* data, uint8_t count)
+{
+    // Wait for a free entry. The interrupt doesn't read the buffer of the tail entry, and
+    // Write() below takes the same entry.
+    uint8_t tail = g_eepromQueueTail;
+    while (NextQueueIndex(tail) == g_eepromQueueHead);
+
+    uint8_t* buffer = g_eepromBuffers[tail];
+    const uint8_t* source = static_cast<const uint8_t*>(data);
+    for (uint8_t i = 0; i < count; ++i)
+        buffer[i] = source[i];
+
+    Write(address, buffer, count);
+}
+
+bool IsBusy()
+{
+    return g_eepromQueueHead != g_eepromQueueTail;
+}
+
+void Wait()
+{
+    while (IsBusy());
+}
+
+void MigrateFields(uint16_t address, const uint8_t* oldLayout, void* data, const uint8_t* newLayout)
+{
+    Wait();
+    for (uint8_t tag; (tag = pgm_read_byte(oldLayout)) != 0; oldLayout += 2)
+    {
+        uint8_t size = pgm_read_byte(oldLayout + 1);
+        if (tag != LAYOUT_SKIP)
+        {
+            // Find the field in the new layout
+            uint8_t offset = 0;
+            const uint8_t* field = newLayout;
+            for (uint8_t newTag; (newTag = pgm_read_byte(field)) != 0; field += 2)
+            {
+                if (newTag == tag)
+                {
+                    if (pgm_read_byte(field + 1) == size)
+                    {
+                        eeprom_read_block(static_cast<uint8_t*>(data) + offset,
+                            reinterpret_cast<const void*>(address), size);
+                    }
+                    break;
+                }
+
+                offset += pgm_read_byte(field + 1);
+            }
+        }
+
+        address += size;
+    }
+}
+
+} // namespace eeprom
@@ -0,0 +1,74 @@
+#pragma once
+
+// Background EEPROM writer. Writes are queued and performed by the EEPROM ready interrupt,
+// so the main code doesn't wait about 3.4 ms for every changed byte.
+
+#include "../data.h"
+
+// Enough for a charger profile. Every queue entry has a buffer of this size.
+#define EEPROM_COPY_BUFFER_SIZE 40
+
+namespace eeprom {
+
+// A queued write (the interrupt uses EEPROM_WRITE_* offsets, see asm_offsets.cpp)
+struct SWrite
+{
+    const uint8_t* m_data;
+    uint16_t m_address;
+    uint16_t m_count;
+};
+
+// Queues writing count bytes from data to the EEPROM address. Only the changed bytes are
+// written, like eeprom_update_block() does. The data is read byte by byte while it's being
+// written, so it mustn't be changed until IsBusy() returns false (Wait() returns), otherwise
+// the EEPROM gets a mix of the old and new values. Use it only for buffers nobody else
+// writes to (see SSettings::SaveToEeprom()), use WriteCopy() for everything else. Waits for
+// a free queue entry if the queue is full.
+void Write(uint16_t address, const void* data, uint16_t count);
+
+// Same, but copies the data (up to EEPROM_COPY_BUFFER_SIZE bytes) to the buffer of the
+// queue entry first, so it can be changed right after the call. Waits only for a free queue
+// entry, like Write().
+void WriteCopy(uint16_t address, const void* data, uint8_t count);
+
+// Whether there are queued writes
+bool IsBusy();
+
+// Waits for all the queued writes to finish. Must be called before the avr-libc EEPROM
+// routines, since they share the EEPROM address and data registers with the interrupt.
+void Wait();
+
+// *** Layout migration ***
+
+// A layout describes a struct stored in the EEPROM. It's a PROGMEM array of the field tag
+// and size pairs terminated by 0. When the struct is changed, its old layouts are kept, so
+// the stored fields can be carried over to the new struct by their tags.
+
+// Tag of the fields that are never carried over (magic numbers, derived values)
+#define LAYOUT_SKIP 0xFF
+
+// Returns the struct size for the layout. For compile time only, since the layouts are
+// in PROGMEM.
+constexpr uint8_t GetLayoutSize(const uint8_t* layout)
+{
+    return *layout ? layout[1] + GetLayoutSize(layout + 2) : 0;
+}
+
+// Copies the fields of the struct stored at the EEPROM address with the old layout to data
+// with the new layout. Only the fields with the same tag and size are copied, the other
+// ones are not changed.
+void MigrateFields(uint16_t address, const uint8_t* oldLayout, void* data, const uint8_t* newLayout);
+
+extern "C" {
+
+// Write queue, the interrupt takes writes from the head, the main code adds them to the tail
+var SWrite g_eepromQueue[EEPROM_QUEUE_SIZE];
+var volatile uint8_t g_eepromQueueHead;
+var volatile uint8_t g_eepromQueueTail;
+
+// WriteCopy() data buffers, one per queue entry
+var uint8_t g_eepromBuffers[EEPROM_QUEUE_SIZE][EEPROM_COPY_BUFFER_SIZE];
+
+} // extern "C"
+
+} // namespace eeprom
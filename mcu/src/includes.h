@@ -30,13 +30,20 @@
 #define DEFAULT_CURRENT_OFFSET -2
 #define DEFAULT_CURRENT_COEFF 12300
 
+// Default PID gains (see g_pidKp and g_pidKi)
+#define DEFAULT_PID_KP 32
+#define DEFAULT_PID_KI 64
+
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
+#include <util/crc16.h>
 #include <stdint.h>
 
 #include "common.h"
 #include "data.h"
 #include "charger_profile.h"
+#include "charge_log.h"
+#include "eeprom/eeprom.h"
 #include "utils.h"
 #include "twi/twi.h"
 #include "one_wire/one_wire.h"
@@ -47,6 +54,8 @@
 #include "display/screen_music_player.h"
 #include "display/screen_settings.h"
 #include "display/screen_charger_profile.h"
+#include "display/screen_diagnostics.h"
+#include "display/screen_charge_history.h"
 #include "sound/music.h"
 
 void CheckForFailures();
@@ -1,5 +1,6 @@
 #include "includes.h"
 
+// There is a host model of this function in sim/control_core.cpp, keep it in sync
 void CheckForFailures()
 {
     uint8_t failureState = g_failureState;
@@ -26,10 +27,9 @@ void CheckForFailures()
         }
     }
 
-    cli();
-    uint16_t voltage = g_adcVoltageAverage;
-    uint16_t current = g_adcCurrentAverage;
-    sei();
+    // Use the fast channel, so the checks don't lag behind the averager
+    uint16_t voltage, current;
+    utils::GetAdcFastValues(voltage, current);
 
     // Overvoltage check.
     // Rule: if output voltage exceeds the set value by more than 1 V and output current exceeds
@@ -47,7 +47,14 @@ void CheckForFailures()
     }
 
     // Overcurrent check.
-    // Rule: if output current exceeds 9A for 150 ms, the overcurrent failure is signaled.
+    // Rule: if output current exceeds 9A for 150 ms or the timer interrupt I^2*t protection
+    // has tripped, the overcurrent failure is signaled.
+    if (g_i2tTripped)
+    {
+        g_i2tTripped = false;
+        failureState |= FAILURE_OVERCURRENT;
+    }
+
     static int8_t overcurrentCounter = 0;
     if (current > 3072)
     {
@@ -76,7 +83,30 @@ void CheckForFailures()
         if (g_outOn)
         {
             if (g_pidMode == PID_MODE_OFF)
-                g_pidMode = PID_MODE_CC;
+            {
+                // Seed the PID with the feed-forward PWM value for the current output
+                // voltage (but not above the target one), so it doesn't have to integrate
+                // all the way up from zero. We can't use the target voltage here: if there
+                // is a battery connected, this would short it through its internal resistance.
+                uint16_t seedVoltage = voltage < g_pidTargetVoltage ? voltage : g_pidTargetVoltage;
+                uint16_t pwm = g_settings.AdcVoltageToFeedForwardPwm(seedVoltage);
+
+                // The I^2*t protection may have tripped since the check above. Don't
+                // switch the PID back on then, the next call will signal the failure.
+                cli();
+                if (!g_i2tTripped)
+                {
+                    if (g_settings.m_pwmPerAdcVoltage)
+                    {
+                        g_pwmValue = pwm;
+                        g_pidIntegral[0] = static_cast<uint8_t>(pwm << 1);
+                        g_pidIntegral[1] = static_cast<uint8_t>(pwm >> 7);
+                        g_pidIntegral[2] = static_cast<uint8_t>(pwm >> 15);
+                    }
+                    g_pidMode = PID_MODE_CC;
+                }
+                sei();
+            }
         }
         else
         {
@@ -165,8 +195,8 @@ void RequestTemperature()
 
     case 3:
         // Read the board temperature and set battery TMP100 resolution to 12 bit
-        *reinterpret_cast<uint8_t*>(&g_temperatureBoard) = twi::g_twiBuffer[1];
-        *(reinterpret_cast<uint8_t*>(&g_temperatureBoard) + 1) = twi::g_twiBuffer[0];
+        *reinterpret_cast<volatile uint8_t*>(&g_temperatureBoard) = twi::g_twiBuffer[1];
+        *(reinterpret_cast<volatile uint8_t*>(&g_temperatureBoard) + 1) = twi::g_twiBuffer[0];
 
         twi::g_twiBuffer[0] = 0x01;
         twi::g_twiBuffer[1] = 0x60;
@@ -188,8 +218,8 @@ void RequestTemperature()
 
     case 6:
         // Read the battery temperature
-        *reinterpret_cast<uint8_t*>(&g_temperatureBattery) = twi::g_twiBuffer[1];
-        *(reinterpret_cast<uint8_t*>(&g_temperatureBattery) + 1) = twi::g_twiBuffer[0];
+        *reinterpret_cast<volatile uint8_t*>(&g_temperatureBattery) = twi::g_twiBuffer[1];
+        *(reinterpret_cast<volatile uint8_t*>(&g_temperatureBattery) + 1) = twi::g_twiBuffer[0];
         break;
 
     case 7:
@@ -230,16 +260,28 @@ static const char pm_mainMenu0[] PROGMEM = "Charger";
 static const char pm_mainMenu1[] PROGMEM = "Power Supply";
 static const char pm_mainMenu2[] PROGMEM = "Settings";
 static const char pm_mainMenu3[] PROGMEM = "Charger profiles";
-static const char pm_mainMenu4[] PROGMEM = "Music player";
-static const char pm_mainMenu5[] PROGMEM = "Calibration";
-static const char pm_mainMenu6[] PROGMEM = "About";
+static const char pm_mainMenu4[] PROGMEM = "Charge history";
+static const char pm_mainMenu5[] PROGMEM = "Music player";
+static const char pm_mainMenu6[] PROGMEM = "Calibration";
+static const char pm_mainMenu7[] PROGMEM = "About";
+#ifdef DIAGNOSTICS
+static const char pm_mainMenu8[] PROGMEM = "Diagnostics";
+#endif
 
 static const display::Menu pm_mainMenu PROGMEM =
 {
     nullptr, nullptr, nullptr,
-    7,
+#ifdef DIAGNOSTICS
+    9,
+#else
+    8,
+#endif
     pm_mainMenuTitle,
-    pm_mainMenu0, pm_mainMenu1, pm_mainMenu2, pm_mainMenu3, pm_mainMenu4, pm_mainMenu5, pm_mainMenu6
+    pm_mainMenu0, pm_mainMenu1, pm_mainMenu2, pm_mainMenu3, pm_mainMenu4, pm_mainMenu5, pm_mainMenu6,
+    pm_mainMenu7,
+#ifdef DIAGNOSTICS
+    pm_mainMenu8,
+#endif
 };
 
 static const char pm_aboutTitle[] PROGMEM = "About";
@@ -269,9 +311,13 @@ int main()
         display::MessageBox(display::pm_warning, pm_invalidSettings, MB_WARNING | MB_OK);
     }
 
-    // Load the last selected charger profile
+    // Convert the profiles saved by an older firmware and load the last selected one
+    charger::SProfile::MigrateEeprom();
     charger::g_profile.LoadFromEeprom(g_settings.m_chargerProfileNumber);
 
+    // Find the last charge session record
+    charge_log::Init();
+
     uint8_t mode = 0;
     for (;;)
     {
@@ -295,16 +341,26 @@ int main()
             break;
 
         case 4:
-            screen::music::Show();
+            screen::history::Show();
             break;
 
         case 5:
-            screen::calibration::Show();
+            screen::music::Show();
             break;
 
         case 6:
+            screen::calibration::Show();
+            break;
+
+        case 7:
             display::MessageBox(pm_aboutTitle, pm_about, MB_OK | MB_INFO);
             break;
+
+#ifdef DIAGNOSTICS
+        case 8:
+            screen::diagnostics::Show();
+            break;
+#endif
         }
     }    
 }
@@ -134,6 +134,85 @@ void WattageToString(uint16_t x1000Voltage, uint16_t x1000Current)
     g_buffer[5] = 'W';
 }
 
+void GetAdcAverages(uint16_t& voltage, uint16_t& current)
+{
+    uint8_t sequence;
+    do
+    {
+        sequence = g_adcAverageSequence;
+        voltage = g_adcVoltageAverage;
+        current = g_adcCurrentAverage;
+    } while (sequence != g_adcAverageSequence);
+}
+
+uint16_t ReadU16(const volatile uint16_t& value)
+{
+    uint16_t result;
+    do
+        result = value;
+    while (result != value);
+
+    return result;
+}
+
+void GetAdcFastValues(uint16_t& voltage, uint16_t& current)
+{
+    voltage = ReadU16(g_adcVoltageFastAcc) >> ADC_FAST_FILTER_SHIFT;
+    current = ReadU16(g_adcCurrentFastAcc) >> ADC_FAST_FILTER_SHIFT;
+}
+
+void GetAdcDisplayValues(uint16_t& voltage, uint16_t& current)
+{
+    // Display filter accumulators (2^ADC_DISPLAY_FILTER_SHIFT times the filtered values)
+    // and the averager sequence number they were last updated at
+    static uint32_t voltageAcc;
+    static uint32_t currentAcc;
+    static uint8_t filterSequence;
+
+    uint8_t sequence;
+    do
+    {
+        sequence = g_adcAverageSequence;
+        voltage = g_adcVoltageHiRes;
+        current = g_adcCurrentHiRes;
+    } while (sequence != g_adcAverageSequence);
+
+    // Run the filter once per each averager update we've missed. If we've missed too many
+    // (the filter has forgotten its state anyway), restart it with the current values.
+    uint8_t updates = sequence - filterSequence;
+    filterSequence = sequence;
+    if (updates > 4 << ADC_DISPLAY_FILTER_SHIFT)
+    {
+        voltageAcc = static_cast<uint32_t>(voltage) << ADC_DISPLAY_FILTER_SHIFT;
+        currentAcc = static_cast<uint32_t>(current) << ADC_DISPLAY_FILTER_SHIFT;
+    }
+    else
+    {
+        for (; updates; --updates)
+        {
+            voltageAcc += voltage - (voltageAcc >> ADC_DISPLAY_FILTER_SHIFT);
+            currentAcc += current - (currentAcc >> ADC_DISPLAY_FILTER_SHIFT);
+        }
+    }
+
+    voltage = static_cast<uint16_t>(voltageAcc >> ADC_DISPLAY_FILTER_SHIFT);
+    current = static_cast<uint16_t>(currentAcc >> ADC_DISPLAY_FILTER_SHIFT);
+}
+
+void ResistanceToString(uint16_t mOhmResistance, int8_t trend)
+{
+    if (mOhmResistance > 9999)
+        mOhmResistance = 9999;
+
+    I16ToString(mOhmResistance, g_buffer, 4);
+    g_buffer[0] = g_buffer[1];
+    g_buffer[1] = g_buffer[2];
+    g_buffer[2] = g_buffer[3];
+    g_buffer[3] = g_buffer[4];
+    g_buffer[4] = 'm';
+    g_buffer[5] = trend > 0 ? '+' : (trend < 0 ? '-' : 127);
+}
+
 void CapacityToString()
 {
     bool largeCapacity = false;
@@ -172,6 +251,62 @@ void CapacityToString()
     g_buffer[7] = 'h';
 }
 
+uint32_t GetEnergyX100000()
+{
+    // Ex1000 = Sum()*Kv*Ki/(4096*4096*1000*3600*7812.5) = (Sum()/16M)*Kv*Ki/28125000000
+    // (see timer_int.S). Normalize Sum()/16M to 17 bits so that the products fit 32 bits.
+    uint32_t energySum = GetEnergySumDiv16M();
+    uint8_t shift = 0;
+    while (energySum > 0x1FFFFul)
+    {
+        energySum >>= 1;
+        ++shift;
+    }
+
+    // energySum*Kv*Ki/32768, then divide by 8583 ~= 28125000000/(32768*100) to get Ex100000
+    energySum = (energySum*g_settings.m_voltage4096Value) >> 15;
+    energySum *= g_settings.m_current4096Value;
+    energySum /= 8583;
+    return energySum > (0xFFFFFFFFul >> shift) ? 0xFFFFFFFFul : energySum << shift;
+}
+
+void EnergyToString()
+{
+    // Keep 3 decimals at most and 5 digits (0xFFFFFFFF/100000 fits 16 bits)
+    uint32_t energySum = GetEnergyX100000();
+    uint8_t decimals = 5;
+    while (energySum > 65535ul || decimals > 3)
+    {
+        energySum /= 10;
+        --decimals;
+    }
+
+    I16ToString(static_cast<uint16_t>(energySum), g_buffer + 1, 4 - decimals);
+    if (decimals)
+    {
+        // Move the integer part left to make room for the point
+        uint8_t point = 5 - decimals;
+        for (uint8_t i = 0; i < point; ++i)
+            g_buffer[i] = g_buffer[i + 1];
+        g_buffer[point] = '.';
+    }
+    else
+    {
+        g_buffer[0] = 127;
+    }
+
+    g_buffer[6] = 'W';
+    g_buffer[7] = 'h';
+}
+
+void CapacityOrEnergyToString()
+{
+    if (g_time[1] & 0x02)
+        EnergyToString();
+    else
+        CapacityToString();
+}
+
 void TimeToString()
 {
     I8ToString(g_time[1], g_buffer + 5);
@@ -187,6 +322,8 @@ void TimeCapacityReset()
     cli();
     g_totalCurrentSum[0] = g_totalCurrentSum[1] = g_totalCurrentSum[2] = 0;
     g_totalCurrentSum[3] = g_totalCurrentSum[4] = g_totalCurrentSum[5] = 0;
+    for (uint8_t& energySum: g_totalEnergySum)
+        energySum = 0;
     g_time[0] = g_time[1] = g_time[2] = g_time[3] = 0;
     sei();
 }
@@ -23,13 +23,27 @@ void CurrentToString(uint16_t x1000Current);
 // Converts x100 wattage to the XXX.X string (5 chars)
 void WattageToString(uint16_t x1000Voltage, uint16_t x1000Current);
 
+// Converts resistance in mOhm to the XXXXm string followed by the trend sign
+// ('+', '-' or a space for trend > 0, < 0 and 0 respectively), 6 chars
+void ResistanceToString(uint16_t mOhmResistance, int8_t trend);
+
 // Converts internal integrated current value to XX.XXXAh or XXX.XXAh string (8 chars)
 void CapacityToString();
 
+// Returns the delivered energy in 10 uWh units (saturated at 0xFFFFFFFF)
+uint32_t GetEnergyX100000();
+
+// Converts internal integrated energy value to X.XXXWh, XX.XXWh, XXX.XWh or XXXXXWh
+// string with a leading space if needed (8 chars)
+void EnergyToString();
+
+// Calls CapacityToString() or EnergyToString(), alternating them every 2 seconds
+void CapacityOrEnergyToString();
+
 // Converts elapsed time to HH-MM-SS string (8 chars)
 void TimeToString();
 
-// Resets time and capacity
+// Resets time, capacity and energy
 void TimeCapacityReset();
 
 // Converts x100 temperature to the XXX.X string 
@@ -56,6 +70,20 @@ uint8_t ChangeI8ByDelta(uint8_t value, int8_t delta, uint8_t minValue, uint8_t m
 
 void ClearPendingKeys();
 
+// Reads the average ADC voltage and current published by the timer interrupt
+// without disabling interrupts (retries if they were updated in the middle)
+void GetAdcAverages(uint16_t& voltage, uint16_t& current);
+
+// Reads a 16-bit value written by an interrupt without disabling interrupts
+uint16_t ReadU16(const volatile uint16_t& value);
+
+// Reads the fast channel voltage and current (ADC average scale)
+void GetAdcFastValues(uint16_t& voltage, uint16_t& current);
+
+// Reads the high resolution voltage and current (16 times the ADC average scale) smoothed by
+// the display filter. Must be called from the main code only.
+void GetAdcDisplayValues(uint16_t& voltage, uint16_t& current);
+
 // Assembler routines
 extern "C" {
 
@@ -75,6 +103,9 @@ void I8ToString(uint8_t value, char *buffer);
 // Gets 32-bit current sum divided by 4M (see timer_int.S for details)
 uint32_t GetCurrentSumDiv4M();
 
+// Gets the 56-bit energy sum divided by 16M (see timer_int.S for details)
+uint32_t GetEnergySumDiv16M();
+
 // Returns the current encoder delta/key and resets them
 int8_t GetEncoderDelta();
 EEncoderKey GetEncoderKey();